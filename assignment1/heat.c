@@ -8,12 +8,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "input.h"
 #include "timing.h"
 
 void usage(char *s) {
-	fprintf(stderr, "Usage: %s <input file> [result file]\n\n", s);
+	fprintf(stderr, "Usage: %s [-W] <input file> [result file]\n\n", s);
+	fprintf(stderr, "  -W        start each resolution from the field of the one before (default: from zero)\n\n");
 }
 
 int main(int argc, char *argv[]) {
@@ -23,14 +25,33 @@ int main(int argc, char *argv[]) {
 
 	// algorithmic parameters
 	algoparam_t param;
-	int np,i;
+	int np = 0, i;
 
-	double runtime, flop;
+	double runtime, flop, bytes;
 	double residual;
 	double time[1000];
 	double floprate[1000];
 	int resolution[1000];
 	int experiment=0;
+	int opt, warm = 0;
+	double *prev;
+	unsigned prevnp;
+
+	// check options
+	while ((opt = getopt(argc, argv, "W")) != -1) {
+		switch (opt) {
+		case 'W':
+			warm = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	// drop the options, keep the program name in argv[0]
+	argv[optind - 1] = argv[0];
+	argc -= optind - 1;
+	argv += optind - 1;
 
 	// check arguments
 	if (argc < 2) {
@@ -78,15 +99,27 @@ int main(int argc, char *argv[]) {
 	// loop over different resolutions
 	while (1) {
 
-		// free allocated memory of previous experiment
-		if (param.u != 0)
+		// free allocated memory of previous experiment, but keep
+		// its field for the warm start
+		prev = 0;
+		if (param.u != 0) {
+			if (warm) {
+				prev = param.u;
+				prevnp = np;
+				param.u = 0;
+			}
 			finalize(&param);
+		}
 
 		if (!initialize(&param)) {
 			fprintf(stderr, "Error in Jacobi initialization.\n\n");
 
 			usage(argv[0]);
 		}
+		if (prev) {
+			prolongate(prev, prevnp, param.u, param.act_res + 2);
+			free(prev);
+		}
 
 		fprintf(stderr, "Resolution: %5u\r", param.act_res);
 
@@ -129,14 +162,15 @@ int main(int argc, char *argv[]) {
 				fprintf(stderr, "residual %f, %d iterations\n", residual, iter);
 		}
 
-		// Flop count after <i> iterations
-		flop = iter * 11.0 * param.act_res * param.act_res;
+		// Flop count and memory traffic after <i> iterations
+		flop = (double)iter * (param.algorithm ? GAUSS_FLOP : JACOBI_FLOP) * param.act_res * param.act_res;
+		bytes = (double)iter * (param.algorithm ? GAUSS_WORDS : JACOBI_WORDS) * sizeof(double) * param.act_res * param.act_res;
 		// stopping time
 		runtime = wtime() - runtime;
 
 		fprintf(stderr, "Resolution: %5u, ", param.act_res);
 		fprintf(stderr, "Time: %04.3f ", runtime);
-		fprintf(stderr, "(%3.3f GFlop => %6.2f MFlop/s, ", flop / 1000000000.0, flop / runtime / 1000000);
+		fprintf(stderr, "(%3.3f GFlop => %6.2f MFlop/s, %5.2f GB/s, ", flop / 1000000000.0, flop / runtime / 1000000, bytes / runtime / 1000000000);
 		fprintf(stderr, "residual %f, %d iterations)\n", residual, iter);
 
 		// for plot...
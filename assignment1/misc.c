@@ -242,3 +242,35 @@ int coarsen( double *uold, unsigned oldx, unsigned oldy ,
   return 1;
 }
 
+/*
+ * bilinear interpolation of the field uold (oldnp x oldnp points,
+ * boundary included) into the inner points of unew (newnp x newnp),
+ * both spanning the same square; the initial guess of a resolution
+ * from the one before
+ */
+void prolongate( double *uold, unsigned oldnp,
+		 double *unew, unsigned newnp )
+{
+    const int on = oldnp, nn = newnp;
+    const double scale = (double)(on-1)/(double)(nn-1);
+    int i;
+
+    for( i=1; i<nn-1; i++ )
+    {
+	const double y = i*scale;
+	const int i0 = (int)y < on-2 ? (int)y : on-2;
+	const double ty = y - i0;
+	int j;
+
+	for( j=1; j<nn-1; j++ )
+	{
+	    const double x = j*scale;
+	    const int j0 = (int)x < on-2 ? (int)x : on-2;
+	    const double tx = x - j0;
+
+	    unew[i*nn+j] =
+		(1-ty) * ((1-tx)*uold[i0*on+j0]     + tx*uold[i0*on+j0+1]) +
+		ty     * ((1-tx)*uold[(i0+1)*on+j0] + tx*uold[(i0+1)*on+j0+1]);
+	}
+    }
+}
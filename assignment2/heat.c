@@ -8,13 +8,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "input.h"
 #include "timing.h"
-#include "h093vao@login22:lrz/sys/tools/papi/5.6/phase2/include/papi.h"
+#include "instrument.h"
 
 void usage(char *s) {
-	fprintf(stderr, "Usage: %s <input file> [result file]\n\n", s);
+	fprintf(stderr, "Usage: %s [-W] [-e set] <input file> [result file]\n\n", s);
+	fprintf(stderr, "  -W        start each resolution from the field of the one before (default: from zero)\n");
+	fprintf(stderr, "  -e set    hardware counters: cache (default) or ipc, if built with -DINSTRUMENT\n\n");
 }
 
 int main(int argc, char *argv[]) {
@@ -22,25 +25,39 @@ int main(int argc, char *argv[]) {
 	FILE *infile, *resfile;
 	char *resfilename;
 
-	//papi initialization
-	int numEvenets = 4;
-	long long values[4];
-	int events[4] = {PAPI_L2_TCM, PAPI_L2_TCA, PAPI_L3_TCM, PAPI_L3_TCA};
-
-	if (PAPI_start_counters(events, numEvents) != PAPI_OK) {
-        printf("PAPI error: %d\n", 1);
-    }
-
 	// algorithmic parameters
 	algoparam_t param;
-	int np,i;
+	int np = 0, i;
 
-	double runtime, flop;
+	double runtime, flop, bytes;
 	double residual;
 	double time[1000];
 	double floprate[1000];
 	int resolution[1000];
 	int experiment=0;
+	int opt, warm = 0;
+	double *prev;
+	unsigned prevnp;
+	char *counters = 0;
+
+	// check options
+	while ((opt = getopt(argc, argv, "We:")) != -1) {
+		switch (opt) {
+		case 'W':
+			warm = 1;
+			break;
+		case 'e':
+			counters = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	// drop the options, keep the program name in argv[0]
+	argv[optind - 1] = argv[0];
+	argc -= optind - 1;
+	argv += optind - 1;
 
 	// check arguments
 	if (argc < 2) {
@@ -76,6 +93,13 @@ int main(int argc, char *argv[]) {
 
 	print_params(&param);
 
+	if (!instr_init(counters)) {
+		fprintf(stderr, "\nError: Unknown counter set \"%s\".\n\n", counters);
+
+		usage(argv[0]);
+		return 1;
+	}
+
 	// set the visualization resolution
 	param.visres = 1024;
 
@@ -88,15 +112,27 @@ int main(int argc, char *argv[]) {
 	// loop over different resolutions
 	while (1) {
 
-		// free allocated memory of previous experiment
-		if (param.u != 0)
+		// free allocated memory of previous experiment, but keep
+		// its field for the warm start
+		prev = 0;
+		if (param.u != 0) {
+			if (warm) {
+				prev = param.u;
+				prevnp = np;
+				param.u = 0;
+			}
 			finalize(&param);
+		}
 
 		if (!initialize(&param)) {
 			fprintf(stderr, "Error in Jacobi initialization.\n\n");
 
 			usage(argv[0]);
 		}
+		if (prev) {
+			prolongate(prev, prevnp, param.u, param.act_res + 2);
+			free(prev);
+		}
 
 		fprintf(stderr, "Resolution: %5u\r", param.act_res);
 
@@ -114,24 +150,22 @@ int main(int argc, char *argv[]) {
 
 			case 0: // JACOBI
 				
+				instr_start(INSTR_RELAX);
 				relax_jacobi(param.u, param.uhelp, np, np);
+				instr_stop(INSTR_RELAX);
+				instr_start(INSTR_RESIDUAL);
 				residual = residual_jacobi(param.u, np, np);
-
-				if ( PAPI_stop_counters(values, numEvents) != PAPI_OK) {
-					("PAPI error: %d\n", 1);
-				}
-
+				instr_stop(INSTR_RESIDUAL);
 				break;
 
 			case 1: // GAUSS
 
+				instr_start(INSTR_RELAX);
 				relax_gauss(param.u, np, np);
+				instr_stop(INSTR_RELAX);
+				instr_start(INSTR_RESIDUAL);
 				residual = residual_gauss(param.u, param.uhelp, np, np);
-
-				if ( PAPI_stop_counters(values, numEvents) != PAPI_OK) {
-					("PAPI error: %d\n", 1);
-				}
-
+				instr_stop(INSTR_RESIDUAL);
 				break;
 			}
 
@@ -149,19 +183,19 @@ int main(int argc, char *argv[]) {
 				fprintf(stderr, "residual %f, %d iterations\n", residual, iter);
 		}
 
-		// Flop count after <i> iterations
-		flop = iter * 11.0 * param.act_res * param.act_res;
+		// Flop count and memory traffic after <i> iterations
+		flop = (double)iter * (param.algorithm ? GAUSS_FLOP : JACOBI_FLOP) * param.act_res * param.act_res;
+		bytes = (double)iter * (param.algorithm ? GAUSS_WORDS : JACOBI_WORDS) * sizeof(double) * param.act_res * param.act_res;
 		// stopping time
 		runtime = wtime() - runtime;
 
 		fprintf(stderr, "Resolution: %5u, ", param.act_res);
 		fprintf(stderr, "Time: %04.3f ", runtime);
-		fprintf(stderr, "(%3.3f GFlop => %6.2f MFlop/s, ", flop / 1000000000.0, flop / runtime / 1000000);
-		fprintf(stderr, "residual %f, %d iterations)", residual, iter);
-		
-		//papi results
-		fprintf(stderr, "L2 cache misses: %d, L2 total cache accesses: %d", values[0], values[1]);
-		fprintf(stderr, "L3 cache misses: %d, L3 total cache accesses: %d\n", values[2], values[3]);
+		fprintf(stderr, "(%3.3f GFlop => %6.2f MFlop/s, %5.2f GB/s, ", flop / 1000000000.0, flop / runtime / 1000000, bytes / runtime / 1000000000);
+		fprintf(stderr, "residual %f, %d iterations)\n", residual, iter);
+
+		// miss rates of this resolution
+		instr_report(stderr, (double)iter * param.act_res * param.act_res);
 
 		// for plot...
 		time[experiment]=runtime;
@@ -184,6 +218,7 @@ int main(int argc, char *argv[]) {
 	write_image(resfile, param.uvis, param.visres + 2, param.visres + 2);
 
 	finalize(&param);
+	instr_finalize();
 
 	return 0;
 }
@@ -7,6 +7,13 @@
 #ifndef JACOBI_H_INCLUDED
 #define JACOBI_H_INCLUDED
 
+// work model per inner point and iteration, the same in all
+// variants: flop and grid words through memory of one update
+#define JACOBI_FLOP 7
+#define JACOBI_WORDS 2
+#define GAUSS_FLOP 4
+#define GAUSS_WORDS 2
+
 #include <stdio.h>
 
 // configuration
@@ -49,6 +56,8 @@ void write_image( FILE * f, double *u,
 		  unsigned sizex, unsigned sizey );
 int coarsen(double *uold, unsigned oldx, unsigned oldy ,
 	    double *unew, unsigned newx, unsigned newy );
+void prolongate( double *uold, unsigned oldnp,
+		 double *unew, unsigned newnp );
 
 // Gauss-Seidel: relax_gauss.c
 double residual_gauss( double *u, double *utmp,
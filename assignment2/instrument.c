@@ -0,0 +1,261 @@
+/*
+ * instrument.c
+ *
+ * Hardware counters for regions of the solver
+ *
+ * The counters of a set run from instr_init on; instr_start and
+ * instr_stop read them and add the difference to the region, so
+ * regions cost two reads and need no restart of the counters.
+ * instr_report prints the miss rates (or IPC) of each region since
+ * the last report and starts over. Events the machine or the backend
+ * does not have are left out and reported as n/a.
+ *
+ */
+
+#ifdef INSTRUMENT
+
+#include <stdlib.h>
+#include <string.h>
+#include "instrument.h"
+
+#ifdef INSTRUMENT_PERF
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#else
+#include <papi.h>
+#endif
+
+enum { L1_ACC, L1_MISS, L2_ACC, L2_MISS, L3_ACC, L3_MISS, INS, CYC, EVENTS };
+
+enum { SET_CACHE, SET_IPC };
+
+static const char *region_name[INSTR_REGIONS] = { "relax", "residual" };
+
+#ifdef INSTRUMENT_PERF
+
+#define BACKEND "perf_event"
+
+#define PERF_L1D(r) (PERF_COUNT_HW_CACHE_L1D | \
+		     (PERF_COUNT_HW_CACHE_OP_READ << 8) | ((r) << 16))
+
+// L2 has no generic event, the last level cache stands in for L3
+static const struct
+{
+  unsigned type;
+  unsigned long long config;
+}
+event[EVENTS] = {
+  { PERF_TYPE_HW_CACHE, PERF_L1D(PERF_COUNT_HW_CACHE_RESULT_ACCESS) },
+  { PERF_TYPE_HW_CACHE, PERF_L1D(PERF_COUNT_HW_CACHE_RESULT_MISS) },
+  { PERF_TYPE_MAX, 0 },
+  { PERF_TYPE_MAX, 0 },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+};
+
+#else
+
+#define BACKEND "PAPI"
+
+static const int event[EVENTS] = {
+  PAPI_L1_DCA, PAPI_L1_DCM, PAPI_L2_TCA, PAPI_L2_TCM,
+  PAPI_L3_TCA, PAPI_L3_TCM, PAPI_TOT_INS, PAPI_TOT_CYC
+};
+
+#endif
+
+static struct
+{
+  int set;
+  int on;                       // any counter running
+  int slot[EVENTS];             // counter of the event, -1 => not counted
+#ifdef INSTRUMENT_PERF
+  int fd[EVENTS];
+#else
+  int eventset;
+#endif
+  double begin[INSTR_REGIONS][EVENTS];
+  double count[INSTR_REGIONS][EVENTS];
+  long calls[INSTR_REGIONS];
+}
+instr;
+
+#ifdef INSTRUMENT_PERF
+
+static int instr_open( int e )
+{
+  struct perf_event_attr attr;
+
+  if (event[e].type == PERF_TYPE_MAX)
+    return -1;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = event[e].type;
+  attr.config = event[e].config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * current counts; counters the kernel multiplexed are scaled up to
+ * the time they were enabled
+ */
+static void instr_read( double *v )
+{
+  unsigned long long buf[3];
+  int e;
+
+  for (e = 0; e < EVENTS; e++) {
+    if (instr.slot[e] < 0)
+      continue;
+    if (read(instr.fd[e], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0)
+      v[e] = 0;
+    else
+      v[e] = (double)buf[0] * buf[1] / buf[2];
+  }
+}
+
+#else
+
+static void instr_read( double *v )
+{
+  long long vals[EVENTS];
+  int e;
+
+  if (PAPI_read(instr.eventset, vals) != PAPI_OK)
+    memset(vals, 0, sizeof(vals));
+  for (e = 0; e < EVENTS; e++)
+    if (instr.slot[e] >= 0)
+      v[e] = (double)vals[instr.slot[e]];
+}
+
+#endif
+
+/*
+ * start the counters of set "cache" (accesses and misses of each
+ * level) or "ipc" (instructions and cycles); returns 0 for an
+ * unknown set. Without counters the regions are not counted.
+ */
+int instr_init( const char *set )
+{
+  int first, last, e, n = 0;
+
+  memset(&instr, 0, sizeof(instr));
+  if (!set || !strcmp(set, "cache"))
+    instr.set = SET_CACHE;
+  else if (!strcmp(set, "ipc"))
+    instr.set = SET_IPC;
+  else
+    return 0;
+  first = (instr.set == SET_CACHE) ? L1_ACC : INS;
+  last = (instr.set == SET_CACHE) ? L3_MISS : CYC;
+
+  for (e = 0; e < EVENTS; e++)
+    instr.slot[e] = -1;
+
+#ifdef INSTRUMENT_PERF
+  for (e = first; e <= last; e++)
+    if ((instr.fd[e] = instr_open(e)) >= 0)
+      instr.slot[e] = n++;
+#else
+  if (PAPI_library_init(PAPI_VER_CURRENT) == PAPI_VER_CURRENT &&
+      PAPI_create_eventset(&instr.eventset) == PAPI_OK) {
+    for (e = first; e <= last; e++)
+      if (PAPI_add_event(instr.eventset, event[e]) == PAPI_OK)
+	instr.slot[e] = n++;
+    if (n > 0 && PAPI_start(instr.eventset) != PAPI_OK)
+      n = 0;
+  }
+#endif
+
+  if (n == 0)
+    fprintf(stderr, "Warning: No hardware counters available (%s), regions are not counted\n", BACKEND);
+  instr.on = (n > 0);
+  return 1;
+}
+
+void instr_start( int region )
+{
+  if (instr.on)
+    instr_read(instr.begin[region]);
+}
+
+void instr_stop( int region )
+{
+  double v[EVENTS];
+  int e;
+
+  if (!instr.on)
+    return;
+  instr_read(v);
+  for (e = 0; e < EVENTS; e++)
+    if (instr.slot[e] >= 0)
+      instr.count[region][e] += v[e] - instr.begin[region][e];
+  instr.calls[region]++;
+}
+
+/*
+ * counters of each region since the last report, per access and per
+ * grid point update (points of them in total)
+ */
+void instr_report( FILE *f, double points )
+{
+  double *c, acc, miss;
+  int r, l;
+
+  if (!instr.on)
+    return;
+  fprintf(f, "Counters (%s):\n", BACKEND);
+  for (r = 0; r < INSTR_REGIONS; r++) {
+    if (instr.calls[r] == 0)
+      continue;
+    c = instr.count[r];
+    fprintf(f, "  %-9s", region_name[r]);
+    if (instr.set == SET_CACHE) {
+      for (l = 0; l < 3; l++) {
+	acc = c[L1_ACC + 2*l];
+	miss = c[L1_MISS + 2*l];
+	if (instr.slot[L1_MISS + 2*l] < 0)
+	  fprintf(f, "  L%d n/a", l+1);
+	else if (instr.slot[L1_ACC + 2*l] < 0 || acc <= 0)
+	  fprintf(f, "  L%d %.3f misses/pt", l+1, miss / points);
+	else
+	  fprintf(f, "  L%d %5.2f%% miss, %.3f/pt", l+1, 100.0 * miss / acc, miss / points);
+      }
+    } else {
+      if (instr.slot[INS] >= 0)
+	fprintf(f, "  %.1f instructions/pt", c[INS] / points);
+      if (instr.slot[CYC] >= 0)
+	fprintf(f, "  %.1f cycles/pt", c[CYC] / points);
+      if (instr.slot[INS] >= 0 && instr.slot[CYC] >= 0 && c[CYC] > 0)
+	fprintf(f, "  IPC %.2f", c[INS] / c[CYC]);
+    }
+    fprintf(f, "\n");
+  }
+  memset(instr.count, 0, sizeof(instr.count));
+  memset(instr.calls, 0, sizeof(instr.calls));
+}
+
+void instr_finalize( void )
+{
+#ifdef INSTRUMENT_PERF
+  int e;
+
+  for (e = 0; e < EVENTS; e++)
+    if (instr.slot[e] >= 0)
+      close(instr.fd[e]);
+#else
+  long long vals[EVENTS];
+
+  if (instr.on)
+    PAPI_stop(instr.eventset, vals);
+#endif
+  instr.on = 0;
+}
+
+#endif // INSTRUMENT
@@ -0,0 +1,37 @@
+/*
+ * instrument.h
+ *
+ * Hardware counters for regions of the solver
+ *
+ * Built with -DINSTRUMENT the regions are counted with PAPI, with
+ * -DINSTRUMENT -DINSTRUMENT_PERF with perf_event_open (Linux, no PAPI
+ * needed). Without INSTRUMENT all calls compile to nothing.
+ */
+
+#ifndef INSTRUMENT_H_INCLUDED
+#define INSTRUMENT_H_INCLUDED
+
+#include <stdio.h>
+
+// regions, each counted on its own
+enum { INSTR_RELAX, INSTR_RESIDUAL, INSTR_REGIONS };
+
+#ifdef INSTRUMENT
+
+int instr_init( const char *set );
+void instr_start( int region );
+void instr_stop( int region );
+void instr_report( FILE *f, double points );
+void instr_finalize( void );
+
+#else
+
+#define instr_init(set)          (1)
+#define instr_start(region)
+#define instr_stop(region)
+#define instr_report(f, points)
+#define instr_finalize()
+
+#endif
+
+#endif // INSTRUMENT_H_INCLUDED
@@ -0,0 +1,304 @@
+/*
+ * checkpoint.c
+ *
+ * Snapshots of the solver state in a memory-mapped file
+ *
+ * The file has a header page and two slots for the grid, snapshots
+ * go to the slots in turn (slot seq & 1). The solver only copies u
+ * into a staging buffer; a writer thread copies it into the mapped
+ * slot, syncs it and only then writes the header of the slot, which
+ * is cleared before the slot is overwritten. So a job killed at any
+ * point leaves at least one complete snapshot, at most one write is
+ * in flight, and --restart takes the newest complete one.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "heat.h"
+
+#define CKPT_MAGIC "HEATCKP1"
+
+// the writer thread of a ckpt_t
+struct ckpt_sync
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+static size_t ckpt_page( void )
+{
+  return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static size_t ckpt_slot_size( size_t bytes )
+{
+  return (bytes + ckpt_page() - 1) / ckpt_page() * ckpt_page();
+}
+
+static size_t ckpt_file_size( size_t bytes )
+{
+  return ckpt_page() + 2 * ckpt_slot_size(bytes);
+}
+
+static ckpt_header_t *ckpt_slot_header( char *map, int slot )
+{
+  return (ckpt_header_t*)(map + slot * sizeof(ckpt_header_t));
+}
+
+static char *ckpt_slot_data( char *map, size_t bytes, int slot )
+{
+  return map + ckpt_page() + slot * ckpt_slot_size(bytes);
+}
+
+static int ckpt_fail( ckpt_t *c )
+{
+  if (c->map && c->map != MAP_FAILED)
+    munmap(c->map, c->size);
+  if (c->fd >= 0)
+    close(c->fd);
+  free(c->stage);
+  free(c->sync);
+  c->map = 0;
+  return 0;
+}
+
+static void *ckpt_writer( void *arg )
+{
+  ckpt_t *c = (ckpt_t*)arg;
+  ckpt_header_t *h;
+
+  for (;;) {
+    pthread_mutex_lock(&c->sync->lock);
+    while (!c->busy && !c->stop)
+      pthread_cond_wait(&c->sync->cond, &c->sync->lock);
+    if (!c->busy) {
+      pthread_mutex_unlock(&c->sync->lock);
+      return 0;
+    }
+    pthread_mutex_unlock(&c->sync->lock);
+
+    h = ckpt_slot_header(c->map, c->next.seq & 1);
+    h->seq = 0;
+    msync(c->map, ckpt_page(), MS_SYNC);
+    memcpy(ckpt_slot_data(c->map, c->bytes, c->next.seq & 1), c->stage, c->bytes);
+    msync(ckpt_slot_data(c->map, c->bytes, c->next.seq & 1), c->bytes, MS_SYNC);
+    *h = c->next;
+    msync(c->map, ckpt_page(), MS_SYNC);
+
+    pthread_mutex_lock(&c->sync->lock);
+    c->busy = 0;
+    pthread_cond_broadcast(&c->sync->cond);
+    pthread_mutex_unlock(&c->sync->lock);
+  }
+}
+
+/*
+ * does the header belong to a snapshot of this run?
+ */
+static int ckpt_match( const ckpt_header_t *h, const algoparam_t *param )
+{
+  return(!memcmp(h->magic, CKPT_MAGIC, sizeof(h->magic)) && h->seq > 0 &&
+	 h->maxiter == param->maxiter &&
+	 h->act_res >= param->initial_res && h->act_res <= param->max_res &&
+	 (h->act_res - param->initial_res) % param->res_step_size == 0);
+}
+
+/*
+ * start snapshots of a sizex x sizey grid to file name, every interval
+ * iterations from iteration iter on. The slots are kept if the file
+ * holds snapshots of the same grid, so a restarted run goes on with
+ * the sequence.
+ */
+int ckpt_open( ckpt_t *c, const char *name, const algoparam_t *param,
+	       unsigned sizex, unsigned sizey, int interval, int iter )
+{
+  struct stat st;
+  ckpt_header_t *h;
+  int keep, s;
+
+  memset(c, 0, sizeof(ckpt_t));
+  c->bytes = sizeof(double) * sizex * sizey;
+  c->size = ckpt_file_size(c->bytes);
+  c->interval = interval;
+  c->due = iter + interval;
+
+  c->fd = open(name, O_RDWR | O_CREAT, 0644);
+  if (c->fd < 0 || fstat(c->fd, &st))
+    return(ckpt_fail(c));
+
+  keep = (st.st_size == (off_t)c->size);
+  if (keep) {
+    c->map = (char*)mmap(0, c->size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if (c->map == MAP_FAILED)
+      return(ckpt_fail(c));
+    for (s = 0; s < 2; s++) {
+      h = ckpt_slot_header(c->map, s);
+      if (h->seq == 0)
+	continue;
+      if (!ckpt_match(h, param) || h->act_res != param->act_res ||
+	  h->sizex != sizex || h->sizey != sizey)
+	keep = 0;
+      else if (h->seq > c->next.seq)
+	c->next.seq = h->seq;
+    }
+    if (!keep)
+      munmap(c->map, c->size);
+  }
+  if (!keep) {
+    c->next.seq = 0;
+    c->map = 0;
+    if (ftruncate(c->fd, 0) || ftruncate(c->fd, c->size))
+      return(ckpt_fail(c));
+    c->map = (char*)mmap(0, c->size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if (c->map == MAP_FAILED)
+      return(ckpt_fail(c));
+  }
+
+  memcpy(c->next.magic, CKPT_MAGIC, sizeof(c->next.magic));
+  c->next.maxiter = param->maxiter;
+  c->next.act_res = param->act_res;
+  c->next.sizex = sizex;
+  c->next.sizey = sizey;
+
+  c->stage = (double*)malloc(c->bytes);
+  c->sync = (struct ckpt_sync*)malloc(sizeof(struct ckpt_sync));
+  if (!c->stage || !c->sync)
+    return(ckpt_fail(c));
+  pthread_mutex_init(&c->sync->lock, 0);
+  pthread_cond_init(&c->sync->cond, 0);
+  if (pthread_create(&c->sync->thread, 0, ckpt_writer, c))
+    return(ckpt_fail(c));
+  return 1;
+}
+
+/*
+ * is a snapshot due after iteration iter?
+ */
+int ckpt_due( const ckpt_t *c, int iter )
+{
+  return(c->map && iter >= c->due);
+}
+
+/*
+ * wait until the snapshot in flight is complete
+ */
+void ckpt_wait( ckpt_t *c )
+{
+  if (!c->map)
+    return;
+  pthread_mutex_lock(&c->sync->lock);
+  while (c->busy)
+    pthread_cond_wait(&c->sync->cond, &c->sync->lock);
+  pthread_mutex_unlock(&c->sync->lock);
+}
+
+/*
+ * snapshot of u after iter iterations; conv and residual are the
+ * state of the convergence monitor, pending whether the check of
+ * residual is still to be done. Returns once u is copied.
+ */
+void ckpt_save( ckpt_t *c, int iter, const converge_t *conv,
+		double residual, int pending, const double *u )
+{
+  if (!c->map)
+    return;
+  ckpt_wait(c);
+
+  memcpy(c->stage, u, c->bytes);
+  c->next.seq++;
+  c->next.iter = iter;
+  c->next.conv = *conv;
+  c->next.residual = residual;
+  c->next.pending = pending;
+  c->due = iter + c->interval;
+
+  pthread_mutex_lock(&c->sync->lock);
+  c->busy = 1;
+  pthread_cond_broadcast(&c->sync->cond);
+  pthread_mutex_unlock(&c->sync->lock);
+}
+
+void ckpt_close( ckpt_t *c )
+{
+  if (!c->map)
+    return;
+  pthread_mutex_lock(&c->sync->lock);
+  c->stop = 1;
+  pthread_cond_broadcast(&c->sync->cond);
+  pthread_mutex_unlock(&c->sync->lock);
+  pthread_join(c->sync->thread, 0);
+
+  munmap(c->map, c->size);
+  close(c->fd);
+  free(c->stage);
+  pthread_mutex_destroy(&c->sync->lock);
+  pthread_cond_destroy(&c->sync->cond);
+  free(c->sync);
+  c->map = 0;
+}
+
+/*
+ * header of the newest complete snapshot of this run in file name
+ * with a sequence number up to maxseq; returns 0 if there is none
+ */
+int ckpt_find( const char *name, const algoparam_t *param,
+	       unsigned maxseq, ckpt_header_t *h )
+{
+  ckpt_header_t *slot;
+  struct stat st;
+  char *map;
+  int fd, s, found = 0;
+
+  fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  if (fstat(fd, &st) || st.st_size < (off_t)ckpt_page()) {
+    close(fd);
+    return 0;
+  }
+  map = (char*)mmap(0, ckpt_page(), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return 0;
+
+  for (s = 0; s < 2; s++) {
+    slot = ckpt_slot_header(map, s);
+    if (ckpt_match(slot, param) && slot->seq <= maxseq &&
+	st.st_size == (off_t)ckpt_file_size(sizeof(double) * slot->sizex * slot->sizey) &&
+	(!found || slot->seq > h->seq)) {
+      *h = *slot;
+      found = 1;
+    }
+  }
+  munmap(map, ckpt_page());
+  return found;
+}
+
+/*
+ * copy the grid of the snapshot with header h into u
+ */
+int ckpt_read( const char *name, const ckpt_header_t *h, double *u )
+{
+  const size_t bytes = sizeof(double) * h->sizex * h->sizey;
+  char *map;
+  int fd;
+
+  fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  map = (char*)mmap(0, ckpt_file_size(bytes), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return 0;
+
+  memcpy(u, ckpt_slot_data(map, bytes, h->seq & 1), bytes);
+  munmap(map, ckpt_file_size(bytes));
+  return 1;
+}
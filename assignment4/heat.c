@@ -1,4 +1,8 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <limits.h>
 
 #include "input.h"
 #include "heat.h"
@@ -6,6 +10,7 @@
 #include "omp.h"
 #include "mmintrin.h"
 #include <papi.h>
+#include "instrument.h"
 
 double* time;
 
@@ -14,7 +19,12 @@ double gettime() {
 }
 
 void usage(char *s) {
-	fprintf(stderr, "Usage: %s <input file> [result file]\n\n", s);
+	fprintf(stderr, "Usage: %s [options] <input file> [result file]\n\n", s);
+	fprintf(stderr, "  -c n      snapshot of the state every n iterations\n");
+	fprintf(stderr, "  -C file   snapshot file (default: %s)\n", CKPT_FILE);
+	fprintf(stderr, "  --restart go on from the newest snapshot in the snapshot file\n");
+	fprintf(stderr, "  -e set    hardware counters: cache (default) or ipc, if built with -DINSTRUMENT\n");
+	fprintf(stderr, "  -W        start each resolution from the field of the one before (default: from zero)\n\n");
 }
 
 int main(int argc, char *argv[]) {
@@ -31,9 +41,51 @@ int main(int argc, char *argv[]) {
 	// timing
 
 	double residual;
+	converge_t conv;
+	int due;
+	int opt, interval = 0, restart = 0, warm = 0;
+	double *prev, *prevhelp;
+	unsigned prevnp = 0;
+	char *ckptname = CKPT_FILE;
+	char *counters = 0;
+	ckpt_t ckpt;
+	ckpt_header_t snap;
+	static struct option longopts[] = {
+		{ "restart", no_argument, 0, 'R' },
+		{ 0, 0, 0, 0 }
+	};
 
 	// set the visualization resolution
 	param.visres = 100;
+	ckpt.map = 0;
+
+	// check options
+	while ((opt = getopt_long(argc, argv, "c:C:We:", longopts, 0)) != -1) {
+		switch (opt) {
+		case 'c':
+			interval = atoi(optarg);
+			break;
+		case 'C':
+			ckptname = optarg;
+			break;
+		case 'R':
+			restart = 1;
+			break;
+		case 'W':
+			warm = 1;
+			break;
+		case 'e':
+			counters = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	// drop the options, keep the program name in argv[0]
+	argv[optind - 1] = argv[0];
+	argc -= optind - 1;
+	argv += optind - 1;
 
 	// check arguments
 	if (argc < 2) {
@@ -68,16 +120,43 @@ int main(int argc, char *argv[]) {
 	}
 
 	print_params(&param);
+	if (!instr_init(counters)) {
+		fprintf(stderr, "\nError: Unknown counter set \"%s\".\n\n", counters);
+
+		usage(argv[0]);
+		return 1;
+	}
+	if (warm)
+		fprintf(stderr, "Initial guess     : previous resolution, bilinear\n");
+	if (restart && !ckpt_find(ckptname, &param, UINT_MAX, &snap)) {
+		fprintf(stderr, "Warning: No snapshot of this run in \"%s\", starting from the beginning\n", ckptname);
+		restart = 0;
+	}
+	if (restart)
+		fprintf(stderr, "Restart           : resolution %u, iteration %d\n", snap.act_res, snap.iter);
 	time = (double *) calloc(sizeof(double), (int) (param.max_res - param.initial_res + param.res_step_size) / param.res_step_size);
 
 	int exp_number = 0;
 
-	for (param.act_res = param.initial_res; param.act_res <= param.max_res; param.act_res = param.act_res + param.res_step_size) {
+	for (param.act_res = restart ? snap.act_res : param.initial_res; param.act_res <= param.max_res; param.act_res = param.act_res + param.res_step_size) {
+		// the field of the resolution before, for the warm start
+		prev = (warm && prevnp) ? param.u : 0;
+		prevhelp = param.uhelp;
+
 		if (!initialize(&param)) {
 			fprintf(stderr, "Error in Jacobi initialization.\n\n");
 
 			usage(argv[0]);
 		}
+		if (prev) {
+			prolongate(prev, prevnp, param.u, param.act_res + 2);
+			free(prev);
+			free(prevhelp);
+		}
+		if (restart && !ckpt_read(ckptname, &snap, param.u)) {
+			fprintf(stderr, "\nError: Cannot read the snapshot in \"%s\".\n\n", ckptname);
+			return 1;
+		}
 
 		for (i = 0; i < param.act_res + 2; i++) {
 			for (j = 0; j < param.act_res + 2; j++) {
@@ -92,9 +171,32 @@ int main(int argc, char *argv[]) {
 
 		t0 = gettime();
 
-		for (iter = 0; iter < param.maxiter; iter++) {
-			residual = relax_jacobi(&(param.u), &(param.uhelp), np, np);
+		converge_init(&conv, RESIDUAL_LIMIT, param.maxiter);
+		iter = 0;
+		if (restart) {
+			iter = snap.iter;
+			conv = snap.conv;
+			residual = snap.residual;
+			restart = 0;
+		}
+		if (interval > 0) {
+			if (!ckpt_open(&ckpt, ckptname, &param, np, np, interval, iter))
+				fprintf(stderr, "Warning: Cannot write snapshots to \"%s\"\n", ckptname);
+			ckpt_save(&ckpt, iter, &conv, residual, 0, param.u);
+		}
+		for (; iter < param.maxiter; ) {
+			due = converge_due(&conv, iter);
+			instr_start(INSTR_RELAX);
+			residual = relax_jacobi(&(param.u), &(param.uhelp), np, np, due);
+			instr_stop(INSTR_RELAX);
+			iter++;
+			if (due && converge_update(&conv, iter - 1, residual))
+				break;
+			// the solver only waits for the copy of u
+			if (ckpt_due(&ckpt, iter))
+				ckpt_save(&ckpt, iter, &conv, residual, 0, param.u);
 		}
+		ckpt_close(&ckpt);
 
 		t1 = gettime();
 		time[exp_number] = wtime() - time[exp_number];
@@ -103,11 +205,15 @@ int main(int argc, char *argv[]) {
 		printf("===================\n");
 		printf("Execution time: %f\n", time[exp_number]);
 		printf("Residual: %f\n\n", residual);
+		printf("Iterations: %d (%d residual checks)\n\n", iter, conv.checks);
 
-		printf("megaflops:  %.1lf\n", (double) param.maxiter * (np - 2) * (np - 2) * 7 / time[exp_number] / 1000000);
-		printf("  flop instructions (M):  %.3lf\n", (double) param.maxiter * (np - 2) * (np - 2) * 7 / 1000000);
+		printf("megaflops:  %.1lf\n", (double) iter * (np - 2) * (np - 2) * JACOBI_FLOP / time[exp_number] / 1000000);
+		printf("  flop instructions (M):  %.3lf\n", (double) iter * (np - 2) * (np - 2) * JACOBI_FLOP / 1000000);
+		printf("  effective GB/s:  %.3lf\n", (double) iter * (np - 2) * (np - 2) * JACOBI_WORDS * sizeof(double) / time[exp_number] / 1000000000);
+		instr_report(stdout, (double) iter * (np - 2) * (np - 2));
 
 		exp_number++;
+		prevnp = np;
 	}
 
 	param.act_res = param.act_res - param.res_step_size;
@@ -117,5 +223,6 @@ int main(int argc, char *argv[]) {
 	write_image(resfile, param.uvis, param.visres + 2, param.visres + 2);
 
 	finalize(&param);
+	instr_finalize();
 	return 0;
 }
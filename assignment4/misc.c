@@ -73,15 +73,25 @@ int initialize( algoparam_t *param )
 
 				      (param->visres+2) );
 
-	#pragma loop_count min(64)
+    // first touch with the same rows per thread as relax_jacobi,
+
+    // the boundary rows go with the first and last inner row
+
+	#pragma parallel
+
+	#pragma loop_count min(8)
 
-    for (i=0;i<np;i++){
+    for (i=1;i<np-1;i++){
+
+	int k, lo = (i==1) ? 0 : i, hi = (i==np-2) ? np : i+1;
+
+	for (k=lo;k<hi;k++)
 
     	for (j=0;j<np;j++){
 
-    		param->u[i*np+j]=0;
+    		param->u[k*np+j]=0;
 
-			param->uhelp[i*np+j]=0;
+			param->uhelp[k*np+j]=0;
 
     	}
 
@@ -523,3 +533,35 @@ int coarsen( double *uold, unsigned oldx, unsigned oldy ,
 
 }
 
+/*
+ * bilinear interpolation of the field uold (oldnp x oldnp points,
+ * boundary included) into the inner points of unew (newnp x newnp),
+ * both spanning the same square; the initial guess of a resolution
+ * from the one before
+ */
+void prolongate( double *uold, unsigned oldnp,
+		 double *unew, unsigned newnp )
+{
+    const int on = oldnp, nn = newnp;
+    const double scale = (double)(on-1)/(double)(nn-1);
+    int i;
+
+    for( i=1; i<nn-1; i++ )
+    {
+	const double y = i*scale;
+	const int i0 = (int)y < on-2 ? (int)y : on-2;
+	const double ty = y - i0;
+	int j;
+
+	for( j=1; j<nn-1; j++ )
+	{
+	    const double x = j*scale;
+	    const int j0 = (int)x < on-2 ? (int)x : on-2;
+	    const double tx = x - j0;
+
+	    unew[i*nn+j] =
+		(1-ty) * ((1-tx)*uold[i0*on+j0]     + tx*uold[i0*on+j0+1]) +
+		ty     * ((1-tx)*uold[(i0+1)*on+j0] + tx*uold[(i0+1)*on+j0+1]);
+	}
+    }
+}
@@ -9,7 +9,7 @@
 
 
 double relax_jacobi( double **u1, double **utmp1,
-         unsigned sizex, unsigned sizey )
+         unsigned sizex, unsigned sizey, int residual )
 {
   int i, j;
   double *help,*u, *utmp,factor=0.5;
@@ -18,6 +18,27 @@ double relax_jacobi( double **u1, double **utmp1,
   u=*u1;
   double unew, diff, sum=0.0;
 
+  // the same sweep without the reduction
+  if (!residual) {
+#pragma parallel 
+#pragma loop_count min(8)
+    for( i=1; i<sizey-1; i++ ) {
+      int ii=i*sizex;
+      int iim1=(i-1)*sizex;
+      int iip1=(i+1)*sizex;
+#pragma ivdep
+      for( j=1; j<sizex-1; j++ )
+        utmp[ii+j] = 0.25 * (u[ ii+(j-1) ]+
+                             u[ ii+(j+1) ]+
+                             u[ iim1+j ]+
+                             u[ iip1+j ]);
+    }
+
+    *u1=utmp;
+    *utmp1=u;
+    return(0);
+  }
+
 #pragma parallel 
 #pragma loop_count min(8)
   for( i=1; i<sizey-1; i++ ) {
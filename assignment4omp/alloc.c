@@ -0,0 +1,134 @@
+/*
+ * alloc.c
+ *
+ * Allocation of the grids
+ *
+ * A grid starts on a cache line, and with a row stride from
+ * grid_stride so does every row of it. Grids of a huge page or more
+ * go on huge pages: by default transparent ones (aligned to a huge
+ * page and marked with madvise), on request explicit ones from the
+ * hugetlbfs pool, which fall back to transparent and then to small
+ * pages. Huge page aligned grids would all start at the same offset
+ * in a 4 KiB page, and the loads from u would alias the stores to
+ * uhelp, so grid n starts (n % GRID_SKEWS) * GRID_SKEW bytes in.
+ * The cache line in front of a grid records how to give it back. No
+ * page is touched here but the first one, the kernels first touch
+ * the rest.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "heat.h"
+
+// in the cache line in front of a grid
+typedef struct
+{
+  size_t size;              // bytes of the allocation
+  size_t skew;              // bytes in front of this line
+  int pages;                // GRID_PAGES_*
+}
+grid_head_t;
+
+static int grid_mode = GRID_PAGES_THP;
+
+static const char *grid_mode_name[] = { "small", "thp", "huge" };
+
+/*
+ * pages of the grids from now on: "small", "thp" or "huge";
+ * returns 0 for an unknown mode
+ */
+int grid_pages( const char *mode )
+{
+  if (!strcmp(mode, "small"))
+    grid_mode = GRID_PAGES_SMALL;
+  else if (!strcmp(mode, "thp"))
+    grid_mode = GRID_PAGES_THP;
+  else if (!strcmp(mode, "huge"))
+    grid_mode = GRID_PAGES_HUGE;
+  else
+    return 0;
+  return 1;
+}
+
+// pages asked for by grid_pages
+const char *grid_pages_name( void )
+{
+  return(grid_mode_name[grid_mode]);
+}
+
+/*
+ * row stride in doubles of a grid with np points per row: whole
+ * cache lines, and one more if the stride is a multiple of
+ * GRID_PAD_STRIDE, where the same column of neighbouring rows falls
+ * into a few cache sets only. np without pad.
+ */
+unsigned grid_stride( unsigned np, int pad )
+{
+  const unsigned line = GRID_ALIGN / sizeof(double);
+  unsigned ld;
+
+  if (!pad)
+    return(np);
+  ld = (np + line - 1) / line * line;
+  if (ld % GRID_PAD_STRIDE == 0)
+    ld += line;
+  return(ld);
+}
+
+void *grid_alloc( size_t bytes )
+{
+  static int warned = 0, count = 0;
+  const size_t skew = (size_t)(count++ % GRID_SKEWS) * GRID_SKEW;
+  size_t size = skew + GRID_ALIGN + bytes;
+  int pages = GRID_PAGES_SMALL;
+  grid_head_t *h;
+  void *p = 0;
+
+#ifdef MAP_HUGETLB
+  if (grid_mode == GRID_PAGES_HUGE && size >= GRID_HUGE_PAGE) {
+    const size_t huge = (size + GRID_HUGE_PAGE - 1) / GRID_HUGE_PAGE * GRID_HUGE_PAGE;
+    p = mmap(0, huge, PROT_READ | PROT_WRITE,
+	     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      size = huge;
+      pages = GRID_PAGES_HUGE;
+    } else {
+      p = 0;
+      if (!warned++)
+	fprintf(stderr, "Warning: No explicit huge pages, using transparent ones\n");
+    }
+  }
+#endif
+  if (!p && grid_mode != GRID_PAGES_SMALL && size >= GRID_HUGE_PAGE) {
+    if (posix_memalign(&p, GRID_HUGE_PAGE, size))
+      p = 0;
+#ifdef MADV_HUGEPAGE
+    else
+      madvise(p, size, MADV_HUGEPAGE);
+#endif
+  }
+  if (!p && posix_memalign(&p, GRID_ALIGN, size))
+    return 0;
+
+  h = (grid_head_t*)((char*)p + skew);
+  h->size = size;
+  h->skew = skew;
+  h->pages = pages;
+  return((char*)h + GRID_ALIGN);
+}
+
+void grid_free( void *grid )
+{
+  grid_head_t *h;
+
+  if (!grid)
+    return;
+  h = (grid_head_t*)((char*)grid - GRID_ALIGN);
+  if (h->pages == GRID_PAGES_HUGE)
+    munmap((char*)h - h->skew, h->size);
+  else
+    free((char*)h - h->skew);
+}
@@ -0,0 +1,162 @@
+/*
+ * bench.c
+ *
+ * Benchmark mode: repetitions of each resolution, statistics and a
+ * machine-readable record per resolution
+ *
+ * The first warmup runs of a resolution are not counted. Of the
+ * others the minimum, median and standard deviation of the time are
+ * reported, and GFLOP/s and effective GB/s from the minimum time with
+ * the model of bench_model(). Records go to a CSV file, or to a JSON
+ * array if the file name ends in .json.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "heat.h"
+
+/*
+ * Work per inner point and iteration (cycle for multigrid, solve for
+ * the direct solver) of each algorithm. Bytes are the minimum traffic:
+ * every grid a pass reads or writes goes through memory once.
+ */
+void bench_model( int algorithm, int precision, unsigned np,
+		  double *flop, double *bytes )
+{
+  const double word = precision ? sizeof(float) : sizeof(double);
+
+  switch (algorithm) {
+  case 1:
+    // red-black SOR: each colour sweep reads both colours and writes one
+    *flop = SOR_FLOP;
+    *bytes = SOR_WORDS * word;
+    break;
+  case 2:
+    // Gauss-Seidel in place
+    *flop = GAUSS_FLOP;
+    *bytes = GAUSS_WORDS * word;
+    break;
+  case 3:
+  case 4:
+    // per cycle: smoothing and residual on the finest level,
+    // restriction and prolongation, 4/3 for the coarser levels
+    *flop = (5.0 * (MG_PRE_SWEEPS + MG_POST_SWEEPS) + 8 + 3 + 2) * 4 / 3;
+    *bytes = 2 * word * (MG_PRE_SWEEPS + MG_POST_SWEEPS + 3) * 4 / 3;
+    if (algorithm == 4) {
+      *flop *= 1.5;
+      *bytes *= 1.5;
+    }
+    break;
+  case 5:
+    // 4 passes of FFTs of length N = 2(np-1), two rows each at
+    // 5 N log2 N flop, not counting the Bluestein overhead; the
+    // passes and the two transposes read and write the grid
+    *flop = 4 * 5 * log2(2.0 * (np - 1)) + 6;
+    *bytes = 2 * word * (4 + 2 + 2);
+    break;
+  default:
+    // Jacobi: read u, write utmp
+    *flop = JACOBI_FLOP;
+    *bytes = JACOBI_WORDS * word;
+    break;
+  }
+}
+
+int bench_init( bench_t *b, int warmup, int runs, const char *file )
+{
+  const char *ext = file ? strrchr(file, '.') : 0;
+
+  memset(b, 0, sizeof(bench_t));
+  b->warmup = warmup;
+  b->runs = runs;
+  b->time = (double*)malloc( sizeof(double) * runs );
+  if (!b->time)
+    return 0;
+  if (file) {
+    if (!(b->out = fopen(file, "w")))
+      return 0;
+    b->json = ext && !strcmp(ext, ".json");
+    if (b->json)
+      fprintf(b->out, "[\n");
+    else
+      fprintf(b->out, "resolution,algorithm,kernel,threads,runs,iterations,"
+	      "min_s,median_s,stddev_s,gflops,gbytes_s\n");
+  }
+  return 1;
+}
+
+/*
+ * time of the current run; returns 1 if it was the last one of the
+ * resolution, which starts the next
+ */
+int bench_add( bench_t *b, double time )
+{
+  if (b->rep >= b->warmup)
+    b->time[b->rep - b->warmup] = time;
+  if (++b->rep < b->warmup + b->runs)
+    return 0;
+  b->rep = 0;
+  return 1;
+}
+
+static int bench_cmp( const void *a, const void *b )
+{
+  const double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/*
+ * statistics of the runs of a resolution with np x np points, each
+ * iters iterations of flop and bytes per inner point
+ */
+void bench_report( bench_t *b, unsigned np, int algorithm,
+		   const char *kernel, int threads, int iters,
+		   double flop, double bytes )
+{
+  const int n = b->runs;
+  const double points = (double)iters * (np - 2) * (np - 2);
+  double *t = b->time, min, median, mean = 0, var = 0, gflops, gbs;
+  int i;
+
+  qsort(t, n, sizeof(double), bench_cmp);
+  min = t[0];
+  median = (n & 1) ? t[n/2] : 0.5 * (t[n/2-1] + t[n/2]);
+  for (i = 0; i < n; i++)
+    mean += t[i] / n;
+  for (i = 0; i < n; i++)
+    var += (t[i] - mean) * (t[i] - mean);
+  var = (n > 1) ? var / (n - 1) : 0;
+  gflops = points * flop / min / 1e9;
+  gbs = points * bytes / min / 1e9;
+
+  if (n > 1 || b->warmup > 0)
+    printf("Benchmark: %d runs after %d warm-up, min %f s, median %f s, stddev %f s, %.3f GFLOP/s, %.3f GB/s\n\n",
+	   n, b->warmup, min, median, sqrt(var), gflops, gbs);
+
+  if (!b->out)
+    return;
+  if (b->json)
+    fprintf(b->out, "%s  {\"resolution\": %u, \"algorithm\": %d, \"kernel\": \"%s\", "
+	    "\"threads\": %d, \"runs\": %d, \"iterations\": %d, \"min_s\": %g, "
+	    "\"median_s\": %g, \"stddev_s\": %g, \"gflops\": %g, \"gbytes_s\": %g}",
+	    b->records ? ",\n" : "", np - 2, algorithm, kernel, threads, n, iters,
+	    min, median, sqrt(var), gflops, gbs);
+  else
+    fprintf(b->out, "%u,%d,%s,%d,%d,%d,%g,%g,%g,%g,%g\n",
+	    np - 2, algorithm, kernel, threads, n, iters,
+	    min, median, sqrt(var), gflops, gbs);
+  b->records++;
+  fflush(b->out);
+}
+
+void bench_close( bench_t *b )
+{
+  if (b->out) {
+    if (b->json)
+      fprintf(b->out, "\n]\n");
+    fclose(b->out);
+  }
+  free(b->time);
+}
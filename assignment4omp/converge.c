@@ -0,0 +1,75 @@
+/*
+ * converge.c
+ *
+ * Convergence monitor: decides in which iterations the residual is
+ * computed and when the solver can stop
+ *
+ * The residual of the relaxation methods falls about geometrically,
+ * r_k ~ r_0 q^k. From the last two checks the monitor estimates q and
+ * the number of iterations left until the tolerance; the next check
+ * comes after half of them (at least 1, at most CONV_MAX_INTERVAL
+ * iterations later). So the solver stops only a few iterations late,
+ * while most iterations skip the reduction. The last iteration is
+ * always checked; with tol <= 0 it is the only one.
+ *
+ */
+
+#include <math.h>
+#include "heat.h"
+
+void converge_init( converge_t *c, double tol, int maxiter )
+{
+  c->tol = tol;
+  c->maxiter = maxiter;
+  c->interval = CONV_INTERVAL;
+  c->next = (tol > 0) ? CONV_INTERVAL-1 : maxiter-1;
+  c->lastiter = -1;
+  c->last = 0;
+  c->checks = 0;
+}
+
+/*
+ * does iteration iter have to compute the residual?
+ */
+int converge_due( const converge_t *c, int iter )
+{
+  return(iter >= c->next || iter >= c->maxiter-1);
+}
+
+/*
+ * residual of iteration iter, returns 1 once it is below the tolerance
+ */
+int converge_update( converge_t *c, int iter, double residual )
+{
+  int interval = c->interval;
+
+  c->checks++;
+  if (c->tol <= 0) {
+    c->next = c->maxiter-1;
+    return 0;
+  }
+  if (residual < c->tol)
+    return 1;
+
+  if (c->lastiter >= 0) {
+    if (residual > 0 && residual < c->last) {
+      // log q per iteration, and iterations left
+      double logq = log(residual / c->last) / (iter - c->lastiter);
+      double left = log(c->tol / residual) / logq;
+      interval = (left/2 < CONV_MAX_INTERVAL) ? (int)(left/2) : CONV_MAX_INTERVAL;
+    } else {
+      // not converging (yet), look less often
+      interval = 2*interval;
+    }
+  }
+  if (interval < 1)
+    interval = 1;
+  if (interval > CONV_MAX_INTERVAL)
+    interval = CONV_MAX_INTERVAL;
+
+  c->interval = interval;
+  c->last = residual;
+  c->lastiter = iter;
+  c->next = iter + interval;
+  return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * fft.c
+ *
+ * Complex FFT of arbitrary length
+ *
+ * Powers of two use an iterative radix-2 transform, other lengths
+ * Bluestein's algorithm on top of it (a convolution of length m, the
+ * next power of two >= 2n-1). A plan is read only once created, so
+ * one plan can be used by all threads, each with its own work array
+ * of fft_work_size() elements.
+ *
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <complex.h>
+#include "heat.h"
+
+/*
+ * in place radix-2 FFT of length m, tw[k] = exp(-2 pi i k/m), k < m/2
+ */
+static void fft_pow2( double complex *x, int m, const double complex *tw )
+{
+  int i, j, k, len;
+
+  // bit reversal
+  for (i = 1, j = 0; i < m; i++) {
+    int bit = m >> 1;
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      double complex t = x[i];
+      x[i] = x[j];
+      x[j] = t;
+    }
+  }
+
+  for (len = 2; len <= m; len <<= 1) {
+    const int half = len >> 1;
+    const int step = m / len;
+    for (i = 0; i < m; i += len) {
+      for (k = 0; k < half; k++) {
+	double complex a = x[i+k];
+	double complex b = x[i+k+half] * tw[k*step];
+	x[i+k] = a + b;
+	x[i+k+half] = a - b;
+      }
+    }
+  }
+}
+
+int fft_init( fft_plan_t *plan, int n )
+{
+  int k;
+
+  plan->n = n;
+  plan->m = 1;
+  while (plan->m < n)
+    plan->m <<= 1;
+  if (plan->m != n) {
+    plan->m = 1;
+    while (plan->m < 2*n-1)
+      plan->m <<= 1;
+  }
+
+  plan->tw = (double complex*)malloc( sizeof(double complex) * (plan->m/2 + 1) );
+  plan->chirp = 0;
+  plan->filter = 0;
+  if (!plan->tw)
+    return 0;
+  for (k = 0; k < plan->m/2 + 1; k++)
+    plan->tw[k] = cexp(-2.0 * M_PI * I * (double)k / (double)plan->m);
+
+  if (plan->m == n)
+    return 1;
+
+  // Bluestein: X_k = c_k sum_j (x_j c_j) conj(c_{k-j}), c_k = exp(-pi i k^2/n)
+  plan->chirp = (double complex*)malloc( sizeof(double complex) * n );
+  plan->filter = (double complex*)calloc( plan->m, sizeof(double complex) );
+  if (!plan->chirp || !plan->filter)
+    return 0;
+  for (k = 0; k < n; k++) {
+    // k^2 mod 2n keeps the angle small and exact
+    long long k2 = ((long long)k * k) % (2LL * n);
+    plan->chirp[k] = cexp(-M_PI * I * (double)k2 / (double)n);
+  }
+  plan->filter[0] = conj(plan->chirp[0]);
+  for (k = 1; k < n; k++)
+    plan->filter[k] = plan->filter[plan->m - k] = conj(plan->chirp[k]);
+  fft_pow2(plan->filter, plan->m, plan->tw);
+
+  return 1;
+}
+
+void fft_free( fft_plan_t *plan )
+{
+  free(plan->tw);
+  free(plan->chirp);
+  free(plan->filter);
+  plan->tw = plan->chirp = plan->filter = 0;
+}
+
+int fft_work_size( const fft_plan_t *plan )
+{
+  return (plan->m == plan->n) ? 0 : plan->m;
+}
+
+/*
+ * in place forward transform of x (length n)
+ */
+void fft_exec( const fft_plan_t *plan, double complex *x, double complex *work )
+{
+  const int n = plan->n, m = plan->m;
+  int k;
+
+  if (m == n) {
+    fft_pow2(x, m, plan->tw);
+    return;
+  }
+
+  for (k = 0; k < n; k++)
+    work[k] = x[k] * plan->chirp[k];
+  for (; k < m; k++)
+    work[k] = 0;
+
+  fft_pow2(work, m, plan->tw);
+  // inverse transform by conjugation
+  for (k = 0; k < m; k++)
+    work[k] = conj(work[k] * plan->filter[k]);
+  fft_pow2(work, m, plan->tw);
+
+  for (k = 0; k < n; k++)
+    x[k] = conj(work[k]) * plan->chirp[k] / (double)m;
+}
@@ -1,4 +1,10 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <limits.h>
+#include <math.h>
 
 #include "input.h"
 #include "heat.h"
@@ -14,7 +20,34 @@ double gettime() {
 }
 
 void usage(char *s) {
-	fprintf(stderr, "Usage: %s <input file> [result file]\n\n", s);
+	fprintf(stderr, "Usage: %s [options] <input file> [result file]\n\n", s);
+	fprintf(stderr, "  -w omega  SOR over-relaxation factor (default: estimated)\n");
+	fprintf(stderr, "  -k name   Jacobi kernel: ");
+	kernel_list(stderr);
+	fprintf(stderr, " or auto (default: plain)\n");
+	fprintf(stderr, "  -x n      tile width\n");
+	fprintf(stderr, "  -y n      tile height\n");
+	fprintf(stderr, "  -s n      sweeps per kernel call (tblocked, diamond)\n");
+	fprintf(stderr, "  -a        with -k auto: tune again even if the tuning file has an entry\n");
+	fprintf(stderr, "  -t file   tuning file (default: %s)\n", TUNE_FILE);
+	fprintf(stderr, "  -L        calibrate the roofline again even if the calibration file has an entry\n");
+	fprintf(stderr, "  -l file   roofline calibration file (default: %s)\n", ROOF_FILE);
+	fprintf(stderr, "  -e tol    stop once the residual is below tol, 0 runs all iterations (default: %g)\n", RESIDUAL_LIMIT);
+	fprintf(stderr, "  -f        Jacobi on float grids, residual in double\n");
+	fprintf(stderr, "  -r n      with -f: up to n double sweeps at the end, until the residual is below tol\n");
+	fprintf(stderr, "  -p bind   pin the threads: close or spread (default: as the OpenMP runtime does)\n");
+	fprintf(stderr, "  -n        report the NUMA placement of the grids\n");
+	fprintf(stderr, "  -P        Jacobi: rows of the grids without padding\n");
+	fprintf(stderr, "  -g pages  pages of the grids: small, thp (transparent huge) or huge (explicit, else thp) (default: thp)\n");
+	fprintf(stderr, "  -i fmt    image format: p6 (colour), p5 (grey) or p3 (ASCII colour) (default: p6)\n");
+	fprintf(stderr, "  -v n      image resolution (default: 100)\n");
+	fprintf(stderr, "  -c n      Jacobi: snapshot of the state every n iterations\n");
+	fprintf(stderr, "  -C file   snapshot file (default: %s)\n", CKPT_FILE);
+	fprintf(stderr, "  --restart go on from the newest snapshot in the snapshot file\n");
+	fprintf(stderr, "  -W        start each resolution from the field of the one before (default: from zero)\n");
+	fprintf(stderr, "  -b n      benchmark: n timed runs of each resolution (default: 1)\n");
+	fprintf(stderr, "  -B n      benchmark: untimed warm-up runs before them (default: 1 with -b, else 0)\n");
+	fprintf(stderr, "  -m file   one record per resolution, CSV or JSON if file ends in .json\n\n");
 }
 
 int main(int argc, char *argv[]) {
@@ -30,10 +63,166 @@ int main(int argc, char *argv[]) {
 
 	// timing
 
-	double residual;
+	double residual, omega = 1.0, flop_per_point, bytes_per_point;
+	int opt, niter;
+	mg_t mg;
+	char *kernelname = "plain", *tunefile = TUNE_FILE;
+	char *rooffile = ROOF_FILE;
+	int recalibrate = 0;
+	roofline_t roof;
+	double intensity, attainable;
+	char *bind = 0;
+	int autotune = 0, retune = 0, bx = 0, by = 0, steps = 0, refine = 0, due;
+	int format = IMAGE_P6;
+	int interval = 0, restart = 0, warm = 0;
+	int runs = 1, warmup = -1, done = 1;
+	char *benchname = 0;
+	bench_t bench;
+	double *prev, *prevhelp;
+	unsigned prevnp = 0, prevld = 0;
+	char *ckptname = CKPT_FILE;
+	ckpt_t ckpt;
+	ckpt_header_t snap;
+	static struct option longopts[] = {
+		{ "restart", no_argument, 0, 'R' },
+		{ 0, 0, 0, 0 }
+	};
+	double tol = RESIDUAL_LIMIT;
+	converge_t conv;
+	kernel_conf_t kc;
 
 	// set the visualization resolution
 	param.visres = 100;
+	param.omega = 0;
+	param.numa = 0;
+	param.precision = 0;
+	param.pad = 1;
+	ckpt.map = 0;
+
+	// check options
+	while ((opt = getopt_long(argc, argv, "w:k:x:y:s:at:Ll:e:fr:p:nPg:i:v:c:C:Wb:B:m:", longopts, 0)) != -1) {
+		switch (opt) {
+		case 'w':
+			param.omega = atof(optarg);
+			break;
+		case 'k':
+			kernelname = optarg;
+			break;
+		case 'x':
+			bx = atoi(optarg);
+			break;
+		case 'y':
+			by = atoi(optarg);
+			break;
+		case 's':
+			steps = atoi(optarg);
+			break;
+		case 'a':
+			retune = 1;
+			break;
+		case 'L':
+			recalibrate = 1;
+			break;
+		case 'l':
+			rooffile = optarg;
+			break;
+		case 't':
+			tunefile = optarg;
+			break;
+		case 'e':
+			tol = atof(optarg);
+			break;
+		case 'f':
+			param.precision = 1;
+			break;
+		case 'r':
+			refine = atoi(optarg);
+			break;
+		case 'p':
+			bind = optarg;
+			break;
+		case 'n':
+			param.numa = 1;
+			break;
+		case 'P':
+			param.pad = 0;
+			break;
+		case 'g':
+			if (!grid_pages(optarg)) {
+				fprintf(stderr, "\nError: Unknown pages \"%s\".\n\n", optarg);
+
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'i':
+			if (!strcmp(optarg, "p3"))
+				format = IMAGE_P3;
+			else if (!strcmp(optarg, "p5"))
+				format = IMAGE_P5;
+			else if (!strcmp(optarg, "p6"))
+				format = IMAGE_P6;
+			else {
+				fprintf(stderr, "\nError: Unknown image format \"%s\".\n\n", optarg);
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'v':
+			param.visres = atoi(optarg);
+			if (param.visres < 1) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'c':
+			interval = atoi(optarg);
+			break;
+		case 'C':
+			ckptname = optarg;
+			break;
+		case 'R':
+			restart = 1;
+			break;
+		case 'W':
+			warm = 1;
+			break;
+		case 'b':
+			runs = atoi(optarg);
+			break;
+		case 'B':
+			warmup = atoi(optarg);
+			break;
+		case 'm':
+			benchname = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	autotune = !strcmp(kernelname, "auto");
+	if (!autotune) {
+		if (!(param.kernel = kernel_find(kernelname))) {
+			fprintf(stderr, "\nError: Unknown kernel \"%s\".\n\n", kernelname);
+
+			usage(argv[0]);
+			return 1;
+		}
+		kernel_defaults(param.kernel, &param.kconf);
+		if (bx > 0 && (param.kernel->flags & KERNEL_TILE_X))
+			param.kconf.bx = bx;
+		if (by > 0 && (param.kernel->flags & KERNEL_TILE_Y))
+			param.kconf.by = by;
+		if (steps > 0 && (param.kernel->flags & KERNEL_STEPS))
+			param.kconf.steps = steps;
+	}
+
+	// drop the options, keep the program name in argv[0]
+	argv[optind - 1] = argv[0];
+	argc -= optind - 1;
+	argv += optind - 1;
 
 	// check arguments
 	if (argc < 2) {
@@ -50,9 +239,9 @@ int main(int argc, char *argv[]) {
 	}
 
 	// check result file
-	resfilename = (argc >= 3) ? argv[2] : "heat.ppm";
+	resfilename = (argc >= 3) ? argv[2] : (format == IMAGE_P5 ? "heat.pgm" : "heat.ppm");
 
-	if (!(resfile = fopen(resfilename, "w"))) {
+	if (!(resfile = fopen(resfilename, "wb"))) {
 		fprintf(stderr, "\nError: Cannot open \"%s\" for writing.\n\n", resfilename);
 
 		usage(argv[0]);
@@ -67,21 +256,125 @@ int main(int argc, char *argv[]) {
 		return 1;
 	}
 
+	if (param.precision && param.algorithm != 0) {
+		fprintf(stderr, "\nError: Float grids are only supported with Jacobi.\n\n");
+
+		usage(argv[0]);
+		return 1;
+	}
+
+	if ((interval > 0 || restart) && (param.algorithm != 0 || param.precision)) {
+		fprintf(stderr, "\nError: Snapshots are only supported with Jacobi in double.\n\n");
+
+		usage(argv[0]);
+		return 1;
+	}
+	if (warmup < 0)
+		warmup = runs > 1 ? 1 : 0;
+	if (runs < 1 || ((runs > 1 || warmup > 0) && (warm || interval > 0 || restart))) {
+		fprintf(stderr, "\nError: Benchmark runs need n >= 1 and start from zero, without -W, -c and --restart.\n\n");
+
+		usage(argv[0]);
+		return 1;
+	}
+	if (!bench_init(&bench, warmup, runs, benchname)) {
+		fprintf(stderr, "\nError: Cannot open \"%s\" for writing.\n\n", benchname);
+
+		usage(argv[0]);
+		return 1;
+	}
+	if (warm && param.precision) {
+		fprintf(stderr, "\nError: The warm start is not supported with float grids.\n\n");
+
+		usage(argv[0]);
+		return 1;
+	}
+
 	print_params(&param);
+	if (restart && !ckpt_find(ckptname, &param, UINT_MAX, &snap)) {
+		fprintf(stderr, "Warning: No snapshot of this run in \"%s\", starting from the beginning\n", ckptname);
+		restart = 0;
+	}
+	if (restart)
+		fprintf(stderr, "Restart           : resolution %u, iteration %d\n", snap.act_res, snap.iter);
+	if (warm)
+		fprintf(stderr, "Initial guess     : previous resolution, bilinear\n");
+	fprintf(stderr, "SIMD kernel       : %s\n", relax_jacobi_simd_init());
+	if (param.precision)
+		fprintf(stderr, "Precision         : float, %d double refinement sweeps at most\n", refine);
+	if (bind && !numa_pin(bind)) {
+		fprintf(stderr, "\nError: Cannot pin the threads \"%s\".\n\n", bind);
+
+		usage(argv[0]);
+		return 1;
+	}
+	// after the pinning, the probes run on the threads of the solver
+	if (recalibrate || !roofline_lookup(rooffile, omp_get_max_threads(), &roof))
+		roofline_calibrate(rooffile, &roof);
+	fprintf(stderr, "Roofline          : %.1f GB/s, %.1f GFLOP/s\n", roof.bandwidth, roof.peak);
 	time = (double *) calloc(sizeof(double), (int) (param.max_res - param.initial_res + param.res_step_size) / param.res_step_size);
 
 	int exp_number = 0;
 
-	for (param.act_res = param.initial_res; param.act_res <= param.max_res; param.act_res = param.act_res + param.res_step_size) {
+	// a resolution is done after its last benchmark run
+	for (param.act_res = restart ? snap.act_res : param.initial_res; param.act_res <= param.max_res; param.act_res = param.act_res + (done ? param.res_step_size : 0)) {
+		// every run starts from scratch
+		if (!done)
+			finalize(&param);
+
+		// pick the Jacobi kernel before initialize(), which first
+		// touches the grid the way the kernel will access it
+		if (autotune && param.algorithm == 0) {
+			const unsigned ld = grid_stride(param.act_res + 2, param.pad);
+
+			if (retune || !kernel_lookup(tunefile, param.act_res + 2, ld, omp_get_max_threads(), &param.kernel, &param.kconf))
+				kernel_autotune(tunefile, param.act_res + 2, ld, &param.kernel, &param.kconf);
+		} else if (autotune) {
+			param.kernel = kernel_find("plain");
+			kernel_defaults(param.kernel, &param.kconf);
+		}
+		// no idle pool threads next to the other solvers
+		if (param.algorithm != 0 || strcmp(param.kernel->name, "pthreads"))
+			stop_jacobi_pthreads();
+		if (param.algorithm == 0)
+			fprintf(stderr, "Jacobi kernel     : %s (bx %d, by %d, steps %d)\n", param.kernel->name, param.kconf.bx, param.kconf.by, param.kconf.steps);
+
+		// the field of the resolution before, for the warm start
+		prev = (warm && prevnp) ? param.u : 0;
+		prevhelp = param.uhelp;
+
 		if (!initialize(&param)) {
 			fprintf(stderr, "Error in Jacobi initialization.\n\n");
 
 			usage(argv[0]);
 		}
+		if (param.numa && param.precision) {
+			numa_report(stderr, "NUMA u (float)", (double *) param.uf, (size_t) (param.act_res + 2) * (param.act_res + 2) / 2, 0);
+			numa_report(stderr, "NUMA uhelp (float)", (double *) param.uhelpf, (size_t) (param.act_res + 2) * (param.act_res + 2) / 2, 0);
+		} else if (param.numa) {
+			numa_report(stderr, "NUMA u", param.u, (size_t) (param.act_res + 2) * param.ld, param.owner);
+			numa_report(stderr, "NUMA uhelp", param.uhelp, (size_t) (param.act_res + 2) * param.ld, param.owner);
+		}
+		if (prev) {
+			prolongate(prev, prevnp, prevld, param.u, param.act_res + 2, param.ld);
+			grid_free(prev);
+			grid_free(prevhelp);
+		}
+		if (restart && snap.sizex != param.ld) {
+			fprintf(stderr, "\nError: The snapshot in \"%s\" has rows of %u points, this run %u (see -P).\n\n", ckptname, snap.sizex, param.ld);
+			return 1;
+		}
+		if (restart && !ckpt_read(ckptname, &snap, param.u)) {
+			fprintf(stderr, "\nError: Cannot read the snapshot in \"%s\".\n\n", ckptname);
+			return 1;
+		}
 
 		for (i = 0; i < param.act_res + 2; i++) {
 			for (j = 0; j < param.act_res + 2; j++) {
-				param.uhelp[i * (param.act_res + 2) + j] = param.u[i * (param.act_res + 2) + j];
+				if (param.precision)
+					param.uhelpf[i * (param.act_res + 2) + j] = param.uf[i * (param.act_res + 2) + j];
+				else
+					param.uhelp[i * param.ld + j] = param.u[i * param.ld + j];
 			}
 		}
 
@@ -91,35 +384,155 @@ int main(int argc, char *argv[]) {
 		np = param.act_res + 2;
 
 		t0 = gettime();
-
-		for (iter = 0; iter < param.maxiter; iter++) {
-# ifndef BLOCKED
-		  residual = relax_jacobi(&(param.u), &(param.uhelp), param.diffs ,np, np);
-#endif
-#ifdef BLOCKED
-		  residual = relax_jacobi_blocked(&(param.u), &(param.uhelp), np, np);
-#endif
+		niter = param.maxiter;
+		converge_init(&conv, tol, param.maxiter);
+
+		if (param.algorithm == 1) {
+		  omega = param.omega > 0 ? param.omega : sor_omega(param.act_res);
+
+		  // the residual comes with the update here, the monitor
+		  // only decides when to stop
+		  sor_split(param.u, param.red, param.black, np, np, 0);
+		  for (niter = 0; niter < param.maxiter; ) {
+		    residual = relax_sor(param.red, param.black, np, np, 0, omega);
+		    niter++;
+		    if (converge_due(&conv, niter - 1) && converge_update(&conv, niter - 1, residual))
+		      break;
+		  }
+		  sor_merge(param.u, param.red, param.black, np, np, 0);
+		} else if (param.algorithm == 2) {
+		  // sweeps are pipelined, the residual is that of the final
+		  // state and costs a sweep, so it is only computed when due
+		  for (niter = 0; niter < param.maxiter; ) {
+		    k = param.maxiter - niter < GTILE_STEPS ? param.maxiter - niter : GTILE_STEPS;
+		    relax_gauss_tasks(param.u, np, np, k);
+		    niter += k;
+		    if (converge_due(&conv, niter - 1)) {
+		      residual = residual_gauss_tasks(param.u, param.uhelp, np, np);
+		      if (converge_update(&conv, niter - 1, residual))
+		        break;
+		    }
+		  }
+		} else if (param.algorithm == 3 || param.algorithm == 4) {
+		  if (!mg_init(&mg, param.u, param.act_res))
+		    return 1;
+		  // a cycle is worth a residual, check every one
+		  for (niter = 0; niter < param.maxiter; ) {
+		    residual = relax_mg(&mg, param.algorithm == 4);
+		    niter++;
+		    if (residual < tol)
+		      break;
+		  }
+		  mg_free(&mg);
+		} else if (param.algorithm == 5) {
+		  niter = 1;
+		  if ((residual = solve_dst(param.u, np, np)) < 0)
+		    return 1;
+		} else {
+		  if (param.precision) {
+		    for (niter = 0; niter < param.maxiter; ) {
+		      due = converge_due(&conv, niter);
+		      residual = relax_jacobi_float(&(param.uf), &(param.uhelpf), np, np, due);
+		      niter++;
+		      if (due && converge_update(&conv, niter - 1, residual))
+		        break;
+		    }
+
+		    // refine in double until the tolerance is met, the
+		    // double grids only exist if there is a refinement
+		    kc = param.kconf;
+		    kc.steps = 1;
+		    if (refine > 0 && !(tol > 0 && residual < tol)) {
+		      if (!grid_to_double(&param))
+		        return 1;
+		      k = conv.checks;
+		      converge_init(&conv, tol, refine);
+		      conv.checks = k;
+		      for (iter = 0; iter < refine; ) {
+		        due = converge_due(&conv, iter);
+		        residual = param.kernel->run(&(param.u), &(param.uhelp), np, np, param.ld, &kc, due);
+		        iter++;
+		        niter++;
+		        if (due && converge_update(&conv, iter - 1, residual))
+		          break;
+		      }
+		    }
+		  } else {
+		    kc = param.kconf;
+		    niter = 0;
+		    if (restart) {
+		      niter = snap.iter;
+		      conv = snap.conv;
+		      residual = snap.residual;
+		      restart = 0;
+		    }
+		    if (interval > 0) {
+		      if (!ckpt_open(&ckpt, ckptname, &param, param.ld, np, interval, niter))
+		        fprintf(stderr, "Warning: Cannot write snapshots to \"%s\"\n", ckptname);
+		      ckpt_save(&ckpt, niter, &conv, residual, 0, param.u);
+		    }
+		    for (; niter < param.maxiter; ) {
+		      if (param.maxiter - niter < kc.steps)
+		        kc.steps = param.maxiter - niter;
+		      due = converge_due(&conv, niter + kc.steps - 1);
+		      residual = param.kernel->run(&(param.u), &(param.uhelp), np, np, param.ld, &kc, due);
+		      niter += kc.steps;
+		      if (due && converge_update(&conv, niter - 1, residual))
+		        break;
+		      // the solver only waits for the copy of u
+		      if (ckpt_due(&ckpt, niter))
+		        ckpt_save(&ckpt, niter, &conv, residual, 0, param.u);
+		    }
+		    ckpt_close(&ckpt);
+		  }
 		}
 
 		t1 = gettime();
 		time[exp_number] = wtime() - time[exp_number];
+		bench_model(param.algorithm, param.precision, np, &flop_per_point, &bytes_per_point);
 
 		printf("\n\nResolution: %u\n", param.act_res);
 		printf("===================\n");
 		printf("Execution time: %f\n", time[exp_number]);
 		printf("Residual: %f\n\n", residual);
-
-		printf("megaflops:  %.1lf\n", (double) param.maxiter * (np - 2) * (np - 2) * 7 / time[exp_number] / 1000000);
-		printf("  flop instructions (M):  %.3lf\n", (double) param.maxiter * (np - 2) * (np - 2) * 7 / 1000000);
-
-		exp_number++;
+		if (param.algorithm == 1)
+			printf("Omega: %f\n\n", omega);
+		if (param.algorithm == 3 || param.algorithm == 4)
+			printf("Cycles: %d\n\n", niter);
+		else if (param.algorithm != 5)
+			printf("Iterations: %d (%d residual checks)\n\n", niter, conv.checks);
+
+		printf("megaflops:  %.1lf\n", (double) niter * (np - 2) * (np - 2) * flop_per_point / time[exp_number] / 1000000);
+		printf("  flop instructions (M):  %.3lf\n", (double) niter * (np - 2) * (np - 2) * flop_per_point / 1000000);
+		printf("  effective GB/s:  %.3lf\n", (double) niter * (np - 2) * (np - 2) * bytes_per_point / time[exp_number] / 1000000000);
+		// the roof is the memory bandwidth, grids that fit in a
+		// cache can go above 100%
+		intensity = flop_per_point / bytes_per_point;
+		attainable = roofline_attainable(&roof, intensity) * 1000;
+		printf("  arithmetic intensity:  %.3lf flop/byte\n", intensity);
+		if (attainable > 0)
+			printf("  roofline (%s bound):  %.1lf MFlop/s attainable, %.1lf%% reached\n",
+			       intensity * roof.bandwidth < roof.peak ? "memory" : "compute", attainable,
+			       100.0 * niter * (np - 2) * (np - 2) * flop_per_point / time[exp_number] / 1000000 / attainable);
+
+		if ((done = bench_add(&bench, time[exp_number]))) {
+			bench_report(&bench, np, param.algorithm, param.algorithm == 0 ? param.kernel->name : "-",
+				     omp_get_max_threads(), niter, flop_per_point, bytes_per_point);
+			exp_number++;
+			prevnp = np;
+			prevld = param.ld;
+		}
 	}
 
 	param.act_res = param.act_res - param.res_step_size;
 
-	coarsen(param.u, param.act_res + 2, param.act_res + 2, param.uvis, param.visres + 2, param.visres + 2);
+	if (param.uf)
+		coarsen_float(param.uf, param.act_res + 2, param.act_res + 2, param.act_res + 2, param.uvis, param.visres + 2, param.visres + 2);
+	else
+		coarsen(param.u, param.act_res + 2, param.act_res + 2, param.ld, param.uvis, param.visres + 2, param.visres + 2);
 
-	write_image(resfile, param.uvis, param.visres + 2, param.visres + 2);
+	write_image(resfile, param.uvis, param.visres + 2, param.visres + 2, format);
+	bench_close(&bench);
 
 	finalize(&param);
 	return 0;
@@ -7,10 +7,103 @@
 #ifndef JACOBI_H_INCLUDED
 #define JACOBI_H_INCLUDED
 
+// work model per inner point and iteration, the same in all
+// variants: flop and grid words through memory of one update
+#define JACOBI_FLOP 7
+#define JACOBI_WORDS 2
+#define SOR_FLOP 9
+#define SOR_WORDS 3
+#define GAUSS_FLOP 4
+#define GAUSS_WORDS 2
+
+// default tile shapes of the Jacobi kernels, all can be changed
+// at runtime (see kernels.c)
+
+// blocked kernel: block width and height
 #define BLOCK_SIZEX 1000
 #define BLOCK_SIZEY 8
-//#define BLOCKED 1
 
+// time-skewed kernel: rows per band and sweeps per call
+#ifndef TBLOCK_SIZEY
+#define TBLOCK_SIZEY 16
+#endif
+#ifndef TBLOCK_STEPS
+#define TBLOCK_STEPS 4
+#endif
+
+// diamond-tiled kernel: rows per band and sweeps per call
+#ifndef DTILE_SIZEY
+#define DTILE_SIZEY 32
+#endif
+#ifndef DTILE_STEPS
+#define DTILE_STEPS 8
+#endif
+
+// pthreads kernel: sweeps per call (one barrier between two sweeps)
+#ifndef PT_STEPS
+#define PT_STEPS 8
+#endif
+
+// Gauss-Seidel wavefront: tile size and sweeps per task graph
+#ifndef GTILE_SIZEX
+#define GTILE_SIZEX 512
+#endif
+#ifndef GTILE_SIZEY
+#define GTILE_SIZEY 64
+#endif
+#ifndef GTILE_STEPS
+#define GTILE_STEPS 16
+#endif
+
+// residual the sequential solver stops at
+#define RESIDUAL_LIMIT 0.000005
+
+// convergence monitor: first and largest interval between checks
+#define CONV_INTERVAL 16
+#define CONV_MAX_INTERVAL 128
+
+// multigrid: smoothing sweeps and size of the coarsest level
+#define MG_MAX_LEVELS 24
+#define MG_COARSE_SIZE 3
+#define MG_PRE_SWEEPS 2
+#define MG_POST_SWEEPS 2
+#define MG_COARSE_SWEEPS 20
+
+// autotuner: tuning file and minimum sweeps/seconds per candidate
+#define TUNE_FILE "heat.tune"
+#define TUNE_MIN_SWEEPS 8
+#define TUNE_MIN_TIME 0.05
+
+// roofline: calibration file, doubles per STREAM array, repetitions
+// of each probe, multiply-add chains per thread and their length
+#define ROOF_FILE "heat.roof"
+#define ROOF_STREAM_SIZE (1 << 24)
+#define ROOF_REPEAT 5
+#define ROOF_FMA_LANES 64
+#define ROOF_FMA_ITER (1 << 22)
+
+// grids: alignment of the rows, strides (in doubles) that get one
+// more cache line, huge page size, offsets of consecutive grids into
+// their first page and the pages of grid_pages
+#define GRID_ALIGN 64
+#define GRID_PAD_STRIDE 64
+#define GRID_HUGE_PAGE (2 << 20)
+#define GRID_SKEW 256
+#define GRID_SKEWS 8
+#define GRID_PAGES_SMALL 0
+#define GRID_PAGES_THP 1
+#define GRID_PAGES_HUGE 2
+
+// image formats of write_image, rows mapped per buffer and columns
+// per vector chunk in the binary ones
+#define IMAGE_P3 3
+#define IMAGE_P5 5
+#define IMAGE_P6 6
+#define IMAGE_ROWS 64
+#define IMAGE_CHUNK 256
+
+// default snapshot file of the checkpoints
+#define CKPT_FILE "heat.ckpt"
 
 #include <stdio.h>
 
@@ -25,6 +118,44 @@ typedef struct
 }
 heatsrc_t;
 
+// tile shape of a Jacobi kernel
+typedef struct
+{
+    int bx, by;             // tile width and height
+    int steps;              // sweeps per call
+}
+kernel_conf_t;
+
+// a Jacobi kernel, advances conf->steps sweeps and swaps u and utmp
+// as needed, returns the residual of the last sweep (or 0 if residual
+// is 0 and the kernel can skip it); rows are ld doubles apart
+typedef double (*jacobi_kernel_t)( double **u, double **utmp,
+				   unsigned sizex, unsigned sizey, unsigned ld,
+				   const kernel_conf_t *conf, int residual );
+
+#define KERNEL_TILE_X 1     // uses conf->bx
+#define KERNEL_TILE_Y 2     // uses conf->by
+#define KERNEL_STEPS  4     // uses conf->steps
+
+// first touch of a kernel: zeroes u and utmp with the same static
+// partition as the kernel, so each page ends up on the NUMA node of
+// the thread that updates it; owner (if not 0) gets the thread of
+// every OWNER_BLOCK elements
+typedef void (*kernel_touch_t)( double *u, double *utmp,
+				unsigned sizex, unsigned sizey, unsigned ld,
+				const kernel_conf_t *conf, int *owner );
+
+#define OWNER_BLOCK 512     // doubles per owner entry (a 4 KiB page)
+
+typedef struct
+{
+    const char *name;
+    jacobi_kernel_t run;
+    kernel_touch_t touch;
+    int flags;              // KERNEL_*
+}
+kernel_t;
+
 typedef struct
 {
     unsigned maxiter;       // maximum number of iterations
@@ -32,9 +163,22 @@ typedef struct
     unsigned max_res;       // spatial resolution
     unsigned initial_res;
     unsigned res_step_size;
+    int algorithm;          // 0=>Jacobi, 1=>red-black SOR, 2=>Gauss,
+                            // 3=>multigrid V-cycle, 4=>multigrid F-cycle,
+                            // 5=>direct (sine transform)
+    double omega;           // SOR over-relaxation, 0=>estimate
     unsigned visres;        // visualization resolution
   
   double *u, *uhelp, *diffs;
+    unsigned ld;            // row stride of u and uhelp
+    int pad;                // Jacobi: pad the row stride
+    int precision;          // 0=>double, 1=>float grids (Jacobi only)
+    float *uf, *uhelpf;     // float grids, instead of u and uhelp
+    double *red, *black;    // SOR: points of each colour
+    const kernel_t *kernel; // Jacobi kernel and its tile shape
+    kernel_conf_t kconf;
+    int numa;               // report the NUMA placement of u and uhelp
+    int *owner;             // with numa: owner map of the first touch
     double *uvis;
 
     unsigned   numsrcs;     // number of heat sources
@@ -42,30 +186,228 @@ typedef struct
 }
 algoparam_t;
 
+// convergence monitor
+typedef struct
+{
+    double tol;             // stop below this residual, <= 0 => never
+    int maxiter;
+    int interval;           // iterations between two checks
+    int next;               // iteration of the next check
+    int lastiter;           // iteration of the last check
+    double last;            // residual of the last check
+    int checks;             // number of checks so far
+}
+converge_t;
+
+// header of a snapshot in the checkpoint file
+typedef struct
+{
+    char magic[8];
+    unsigned seq;           // number of the snapshot, 0 => slot empty
+    int algorithm;
+    unsigned maxiter;
+    unsigned act_res;
+    unsigned sizex, sizey;
+    int iter;               // iterations done
+    double residual;        // last residual
+    int pending;            // residual not checked yet
+    converge_t conv;
+}
+ckpt_header_t;
+
+// checkpoints in progress
+typedef struct
+{
+    int fd;
+    char *map;              // the file, 0 => no checkpoints
+    size_t size, bytes;     // of the file and of one grid
+    double *stage;          // copy of u being written
+    ckpt_header_t next;     // header of the snapshot being written
+    int interval, due;      // iterations between snapshots, next one
+    int busy, stop;
+    struct ckpt_sync *sync; // writer thread and its lock
+}
+ckpt_t;
+
+// benchmark runs of a resolution
+typedef struct
+{
+    int warmup, runs;       // untimed and timed runs
+    int rep;                // current run
+    double *time;           // of the timed runs
+    FILE *out;              // records, 0 => none
+    int json, records;
+}
+bench_t;
+
+// machine limits of the roofline model
+typedef struct
+{
+    double bandwidth;       // GB/s, STREAM triad
+    double peak;            // GFLOP/s, multiply-add
+}
+roofline_t;
+
+// FFT plan (complex.h is left out here, it defines I)
+typedef struct
+{
+    int n;                  // transform length
+    int m;                  // power of two length used internally
+    double _Complex *tw;     // exp(-2 pi i k/m)
+    double _Complex *chirp;  // Bluestein only
+    double _Complex *filter;
+}
+fft_plan_t;
+
+// multigrid levels, 0 is the finest
+typedef struct
+{
+    int nlev;
+    unsigned n[MG_MAX_LEVELS];       // inner points per dimension
+    double *u[MG_MAX_LEVELS];        // solution / error
+    double *f[MG_MAX_LEVELS];        // right hand side
+    double *r[MG_MAX_LEVELS];        // residual
+}
+mg_t;
+
 
 // function declarations
 
 // misc.c
 int initialize( algoparam_t *param );
 int finalize( algoparam_t *param );
+int grid_to_double( algoparam_t *param );
 void write_image( FILE * f, double *u,
-		  unsigned sizex, unsigned sizey );
-int coarsen(double *uold, unsigned oldx, unsigned oldy ,
+		  unsigned sizex, unsigned sizey, int format );
+int coarsen(double *uold, unsigned oldx, unsigned oldy , unsigned oldld,
 	    double *unew, unsigned newx, unsigned newy );
+int coarsen_float( float *uold, unsigned oldx, unsigned oldy, unsigned oldld,
+		   double *unew, unsigned newx, unsigned newy );
+void prolongate( double *uold, unsigned oldnp, unsigned oldld,
+		 double *unew, unsigned newnp, unsigned newld );
+
+// grid allocation: alloc.c
+int grid_pages( const char *mode );
+const char *grid_pages_name( void );
+unsigned grid_stride( unsigned np, int pad );
+void *grid_alloc( size_t bytes );
+void grid_free( void *grid );
 
 // Gauss-Seidel: relax_gauss.c
 double residual_gauss( double *u, double *utmp,
 		       unsigned sizex, unsigned sizey );
 void relax_gauss( double *u, 
 		  unsigned sizex, unsigned sizey  );
+double residual_gauss_tasks( double *u, double *utmp,
+		       unsigned sizex, unsigned sizey );
+void relax_gauss_tasks( double *u,
+		  unsigned sizex, unsigned sizey, int nsweeps );
 
 // Jacobi: relax_jacobi.c
 double residual_jacobi( double *u,
-			unsigned sizex, unsigned sizey );
+			unsigned sizex, unsigned sizey, unsigned ld );
 double relax_jacobi( double **u, double **utmp, double *diffs,
-		   unsigned sizex, unsigned sizey );
+		   unsigned sizex, unsigned sizey, unsigned ld, int residual );
 double relax_jacobi_blocked( double **u, double **utmp,
-		   unsigned sizex, unsigned sizey ); 
+		   unsigned sizex, unsigned sizey, unsigned ld, int bx, int by,
+		   int residual );
+double relax_jacobi_tblocked( double **u, double **utmp,
+		   unsigned sizex, unsigned sizey, unsigned ld, int height,
+		   int nsteps, int residual );
+double relax_jacobi_diamond( double **u, double **utmp,
+		   unsigned sizex, unsigned sizey, unsigned ld, int height,
+		   int nsteps, int residual );
+double relax_jacobi_float( float **u, float **utmp,
+		   unsigned sizex, unsigned sizey, int residual );
+void touch_jacobi_float( float *u, float *utmp,
+		   unsigned sizex, unsigned sizey );
+
+// kernel registry and autotuner: kernels.c
+const kernel_t *kernel_find( const char *name );
+void kernel_list( FILE *f );
+void kernel_defaults( const kernel_t *kernel, kernel_conf_t *conf );
+int kernel_lookup( const char *tunefile, unsigned np, unsigned ld, int threads,
+		   const kernel_t **kernel, kernel_conf_t *conf );
+void kernel_autotune( const char *tunefile, unsigned np, unsigned ld,
+		      const kernel_t **kernel, kernel_conf_t *conf );
+
+// convergence monitor: converge.c
+void converge_init( converge_t *c, double tol, int maxiter );
+int converge_due( const converge_t *c, int iter );
+int converge_update( converge_t *c, int iter, double residual );
+
+// benchmark mode: bench.c
+void bench_model( int algorithm, int precision, unsigned np,
+		  double *flop, double *bytes );
+int bench_init( bench_t *b, int warmup, int runs, const char *file );
+int bench_add( bench_t *b, double time );
+void bench_report( bench_t *b, unsigned np, int algorithm,
+		   const char *kernel, int threads, int iters,
+		   double flop, double bytes );
+void bench_close( bench_t *b );
+
+// roofline calibration: roofline.c
+int roofline_lookup( const char *rooffile, int threads, roofline_t *roof );
+void roofline_calibrate( const char *rooffile, roofline_t *roof );
+double roofline_attainable( const roofline_t *roof, double intensity );
+
+// checkpoint/restart: checkpoint.c
+int ckpt_open( ckpt_t *c, const char *name, const algoparam_t *param,
+	       unsigned sizex, unsigned sizey, int interval, int iter );
+int ckpt_due( const ckpt_t *c, int iter );
+void ckpt_wait( ckpt_t *c );
+void ckpt_save( ckpt_t *c, int iter, const converge_t *conv,
+		double residual, int pending, const double *u );
+void ckpt_close( ckpt_t *c );
+int ckpt_find( const char *name, const algoparam_t *param,
+	       unsigned maxseq, ckpt_header_t *h );
+int ckpt_read( const char *name, const ckpt_header_t *h, double *u );
+
+// thread pinning and page placement: numa.c
+int numa_pin( const char *policy );
+void numa_report( FILE *f, const char *name, double *a, size_t n,
+		  const int *owner );
+
+// red-black SOR: relax_sor.c
+double sor_omega( unsigned res );
+void sor_split( double *u, double *red, double *black,
+		unsigned sizex, unsigned sizey, int par );
+void sor_merge( double *u, double *red, double *black,
+		unsigned sizex, unsigned sizey, int par );
+double relax_sor_colour( double *red, double *black,
+		unsigned sizex, unsigned sizey, int par,
+		int colour, double omega );
+double relax_sor( double *red, double *black,
+		unsigned sizex, unsigned sizey, int par, double omega );
+
+// multigrid: relax_mg.c
+int mg_init( mg_t *mg, double *u, unsigned res );
+void mg_free( mg_t *mg );
+double relax_mg( mg_t *mg, int fcycle );
+
+// FFT: fft.c
+int fft_init( fft_plan_t *plan, int n );
+void fft_free( fft_plan_t *plan );
+int fft_work_size( const fft_plan_t *plan );
+void fft_exec( const fft_plan_t *plan, double _Complex *x,
+	       double _Complex *work );
+
+// direct solver: solve_dst.c
+double solve_dst( double *u, unsigned sizex, unsigned sizey );
+
+// Jacobi, SSE2/AVX2/AVX-512: relax_jacobi_simd.c
+const char *relax_jacobi_simd_init();
+double relax_jacobi_simd( double **u, double **utmp,
+		   unsigned sizex, unsigned sizey, unsigned ld );
+
+// Jacobi on a persistent thread pool: relax_jacobi_pthreads.c
+double relax_jacobi_pthreads( double **u, double **utmp,
+			      unsigned sizex, unsigned sizey, unsigned ld,
+			      int nsteps, int residual );
+void touch_jacobi_pthreads( double *u, double *utmp,
+			    unsigned sizex, unsigned sizey, unsigned ld,
+			    int *owner );
+void stop_jacobi_pthreads( void );
 
 
 #endif // JACOBI_H_INCLUDED
@@ -39,6 +39,7 @@ int read_input( FILE *infile, algoparam_t *param )
    n = sscanf( buf, "%u", &(alg) );
    if( n!=1 )
      return 0;
+   param->algorithm = alg;
 
 
   fgets(buf, BUFSIZE, infile);
@@ -75,6 +76,12 @@ void print_params( algoparam_t *param )
 	  param->initial_res + param->res_step_size,
 	  param->max_res);
   fprintf(stderr, "Iterations        : %u\n", param->maxiter);
+  fprintf(stderr, "Algorithm         : %s\n",
+	  param->algorithm == 1 ? "red-black SOR" :
+	  param->algorithm == 2 ? "Gauss-Seidel" :
+	  param->algorithm == 3 ? "multigrid V-cycle" :
+	  param->algorithm == 4 ? "multigrid F-cycle" :
+	  param->algorithm == 5 ? "direct (sine transform)" : "Jacobi");
   fprintf(stderr, "Num. Heat sources : %u\n", param->numsrcs);
 
   for( i=0; i<param->numsrcs; i++ )
@@ -0,0 +1,385 @@
+/*
+ * kernels.c
+ *
+ * Registry of the Jacobi kernels, their first touch and an empirical
+ * autotuner
+ *
+ * The autotuner times every kernel with a few tile shapes at the
+ * given resolution and the current number of threads. Winners are
+ * appended to a tuning file, one line per resolution, row stride,
+ * pages of the grids (see grid_pages) and thread count:
+ *
+ *   <np> <ld> <pages> <threads> <kernel> <bx> <by> <steps> <seconds per sweep>
+ *
+ * Later runs take the last matching line from there.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "heat.h"
+#include "timing.h"
+
+#define TUNE_BUFSIZE 200
+
+static double run_plain( double **u, double **utmp,
+			 unsigned sizex, unsigned sizey, unsigned ld,
+			 const kernel_conf_t *conf, int residual )
+{
+  (void)conf;
+  return(relax_jacobi(u, utmp, 0, sizex, sizey, ld, residual));
+}
+
+static double run_blocked( double **u, double **utmp,
+			   unsigned sizex, unsigned sizey, unsigned ld,
+			   const kernel_conf_t *conf, int residual )
+{
+  return(relax_jacobi_blocked(u, utmp, sizex, sizey, ld, conf->bx, conf->by,
+			      residual));
+}
+
+static double run_tblocked( double **u, double **utmp,
+			    unsigned sizex, unsigned sizey, unsigned ld,
+			    const kernel_conf_t *conf, int residual )
+{
+  return(relax_jacobi_tblocked(u, utmp, sizex, sizey, ld, conf->by, conf->steps,
+			       residual));
+}
+
+static double run_diamond( double **u, double **utmp,
+			   unsigned sizex, unsigned sizey, unsigned ld,
+			   const kernel_conf_t *conf, int residual )
+{
+  return(relax_jacobi_diamond(u, utmp, sizex, sizey, ld, conf->by, conf->steps,
+			      residual));
+}
+
+static double run_simd( double **u, double **utmp,
+			unsigned sizex, unsigned sizey, unsigned ld,
+			const kernel_conf_t *conf, int residual )
+{
+  // the vector rows always sum up the residual, in registers
+  (void)conf;
+  (void)residual;
+  return(relax_jacobi_simd(u, utmp, sizex, sizey, ld));
+}
+
+static double run_pthreads( double **u, double **utmp,
+			    unsigned sizex, unsigned sizey, unsigned ld,
+			    const kernel_conf_t *conf, int residual )
+{
+  return(relax_jacobi_pthreads(u, utmp, sizex, sizey, ld, conf->steps, residual));
+}
+
+/*
+ * First touch of rows i0..i1-1, columns j0..j1-1; a part at the edge
+ * of the inner points takes the boundary (and the padding of the
+ * rows) next to it along
+ */
+static void touch_box( double *u, double *utmp,
+		       unsigned sizex, unsigned sizey, unsigned ld,
+		       int i0, int i1, int j0, int j1, int *owner )
+{
+  const int tid = omp_get_thread_num();
+  int i, j;
+
+  if (i0 == 1) i0 = 0;
+  if (i1 == sizey-1) i1 = sizey;
+  if (j0 == 1) j0 = 0;
+  if (j1 == sizex-1) j1 = ld;
+
+  for (i = i0; i < i1; i++) {
+    const int ii = i*ld;
+    for (j = j0; j < j1; j++) {
+      u[ii+j] = 0;
+      utmp[ii+j] = 0;
+    }
+    if (owner)
+      for (j = (ii+j0) / OWNER_BLOCK; j <= (ii+j1-1) / OWNER_BLOCK; j++)
+	owner[j] = tid;
+  }
+}
+
+// rows as in relax_jacobi and relax_jacobi_simd
+static void touch_rows( double *u, double *utmp,
+			unsigned sizex, unsigned sizey, unsigned ld,
+			const kernel_conf_t *conf, int *owner )
+{
+  int i;
+
+  (void)conf;
+
+#pragma omp parallel for
+  for (i = 1; i < sizey-1; i++)
+    touch_box(u, utmp, sizex, sizey, ld, i, i+1, 1, sizex-1, owner);
+}
+
+// blocks as in relax_jacobi_blocked
+static void touch_blocked( double *u, double *utmp,
+			   unsigned sizex, unsigned sizey, unsigned ld,
+			   const kernel_conf_t *conf, int *owner )
+{
+  const int sx = conf->bx < (int)sizex-2 ? conf->bx : (int)sizex-2;
+  const int sy = conf->by < (int)sizey-2 ? conf->by : (int)sizey-2;
+  const int numx = (sizex-2) / sx;
+  const int numy = (sizey-2) / sy;
+  const int xrem = (sizex-2) % sx;
+  const int yrem = (sizey-2) % sy;
+  int b;
+
+#pragma omp parallel for
+  for (b = 0; b < numx * numy; b++) {
+    int by = b / numx;
+    int bx = b % numx;
+    int starty = 1 + by * sy;
+    int startx = 1 + bx * sx;
+    int endx = startx + sx + (int)(bx == (numx-1)) * xrem;
+    int endy = starty + sy + (int)(by == (numy-1)) * yrem;
+    touch_box(u, utmp, sizex, sizey, ld, starty, endy, startx, endx, owner);
+  }
+}
+
+// bands dealt out round robin as in relax_jacobi_tblocked
+static void touch_tblocked( double *u, double *utmp,
+			    unsigned sizex, unsigned sizey, unsigned ld,
+			    const kernel_conf_t *conf, int *owner )
+{
+  const int height = conf->by < 2 ? 2 : conf->by;
+  const int numy = (sizey-2) / height < 1 ? 1 : (sizey-2) / height;
+
+#pragma omp parallel
+  {
+    const int nthreads = omp_get_num_threads();
+    int b;
+
+    for (b = omp_get_thread_num(); b < numy; b += nthreads) {
+      const int starty = 1 + b * height;
+      const int endy = (b == numy-1) ? (int)sizey-1 : starty + height;
+      touch_box(u, utmp, sizex, sizey, ld, starty, endy, 1, sizex-1, owner);
+    }
+  }
+}
+
+// bands as the upright trapezoids of relax_jacobi_diamond
+static void touch_diamond( double *u, double *utmp,
+			   unsigned sizex, unsigned sizey, unsigned ld,
+			   const kernel_conf_t *conf, int *owner )
+{
+  const int height = conf->by < 2*conf->steps ? 2*conf->steps : conf->by;
+  const int numy = (sizey-2) / height < 1 ? 1 : (sizey-2) / height;
+  int b;
+
+#pragma omp parallel for schedule(static)
+  for (b = 0; b < numy; b++) {
+    const int starty = 1 + b * height;
+    const int endy = (b == numy-1) ? (int)sizey-1 : starty + height;
+    touch_box(u, utmp, sizex, sizey, ld, starty, endy, 1, sizex-1, owner);
+  }
+}
+
+// slabs of the thread pool, touched by the pool threads themselves
+static void touch_pthreads( double *u, double *utmp,
+			    unsigned sizex, unsigned sizey, unsigned ld,
+			    const kernel_conf_t *conf, int *owner )
+{
+  (void)conf;
+  touch_jacobi_pthreads(u, utmp, sizex, sizey, ld, owner);
+}
+
+static const kernel_t kernels[] = {
+  { "plain",    run_plain,    touch_rows,     0 },
+  { "blocked",  run_blocked,  touch_blocked,  KERNEL_TILE_X | KERNEL_TILE_Y },
+  { "tblocked", run_tblocked, touch_tblocked, KERNEL_TILE_Y | KERNEL_STEPS },
+  { "diamond",  run_diamond,  touch_diamond,  KERNEL_TILE_Y | KERNEL_STEPS },
+  { "simd",     run_simd,     touch_rows,     0 },
+  { "pthreads", run_pthreads, touch_pthreads, KERNEL_STEPS },
+  { 0, 0, 0, 0 }
+};
+
+// tile shapes tried by the autotuner
+static const int tune_bx[] = { 256, 1000, 4000 };
+static const int tune_by[] = { 4, 8, 16, 32, 64 };
+static const int tune_steps[] = { 2, 4, 8 };
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+
+const kernel_t *kernel_find( const char *name )
+{
+  int k;
+
+  for (k = 0; kernels[k].name; k++)
+    if (!strcmp(kernels[k].name, name))
+      return(&kernels[k]);
+  return(0);
+}
+
+void kernel_list( FILE *f )
+{
+  int k;
+
+  for (k = 0; kernels[k].name; k++)
+    fprintf(f, "%s%s", k ? ", " : "", kernels[k].name);
+}
+
+void kernel_defaults( const kernel_t *kernel, kernel_conf_t *conf )
+{
+  conf->bx = BLOCK_SIZEX;
+  conf->by = BLOCK_SIZEY;
+  conf->steps = 1;
+
+  if (!strcmp(kernel->name, "tblocked")) {
+    conf->by = TBLOCK_SIZEY;
+    conf->steps = TBLOCK_STEPS;
+  } else if (!strcmp(kernel->name, "diamond")) {
+    conf->by = DTILE_SIZEY;
+    conf->steps = DTILE_STEPS;
+  } else if (!strcmp(kernel->name, "pthreads")) {
+    conf->steps = PT_STEPS;
+  }
+}
+
+/*
+ * Look up np, ld, the pages of the grids and threads in the tuning
+ * file, returns 0 if there is no entry
+ */
+int kernel_lookup( const char *tunefile, unsigned np, unsigned ld, int threads,
+		   const kernel_t **kernel, kernel_conf_t *conf )
+{
+  FILE *f;
+  char buf[TUNE_BUFSIZE], pages[TUNE_BUFSIZE], name[TUNE_BUFSIZE];
+  unsigned fnp, fld;
+  int fthreads, found = 0;
+  kernel_conf_t c;
+
+  if (!(f = fopen(tunefile, "r")))
+    return 0;
+
+  while (fgets(buf, TUNE_BUFSIZE, f)) {
+    if (sscanf(buf, "%u %u %s %d %s %d %d %d", &fnp, &fld, pages, &fthreads,
+	       name, &c.bx, &c.by, &c.steps) != 8)
+      continue;
+    if (fnp != np || fld != ld || strcmp(pages, grid_pages_name()) ||
+	fthreads != threads || !kernel_find(name))
+      continue;
+    *kernel = kernel_find(name);
+    *conf = c;
+    found = 1;
+  }
+
+  fclose(f);
+  return found;
+}
+
+/*
+ * seconds per sweep of kernel with conf, on fresh grids with row
+ * stride ld first touched by the kernel itself, -1 if out of memory
+ */
+static double tune_time( const kernel_t *kernel, const kernel_conf_t *conf,
+			 unsigned np, unsigned ld )
+{
+  double *u, *utmp, t;
+  int sweeps = 0, i;
+
+  u = (double*)grid_alloc( sizeof(double) * np*ld );
+  utmp = (double*)grid_alloc( sizeof(double) * np*ld );
+  if (!u || !utmp) {
+    grid_free(u);
+    grid_free(utmp);
+    return -1;
+  }
+
+  // a hot boundary, so the values do not stay 0
+  kernel->touch(u, utmp, np, np, ld, conf, 0);
+  for (i = 0; i < np; i++)
+    u[i] = utmp[i] = 1.0;
+
+  // warm up
+  kernel->run(&u, &utmp, np, np, ld, conf, 0);
+
+  t = wtime();
+  do {
+    kernel->run(&u, &utmp, np, np, ld, conf, 0);
+    sweeps += conf->steps;
+  } while (sweeps < TUNE_MIN_SWEEPS || wtime() - t < TUNE_MIN_TIME);
+  t = (wtime() - t) / sweeps;
+
+  grid_free(u);
+  grid_free(utmp);
+  return(t);
+}
+
+/*
+ * Time all kernels and tile shapes at resolution np, row stride ld,
+ * with the current number of threads, return the fastest and append
+ * it to tunefile
+ */
+void kernel_autotune( const char *tunefile, unsigned np, unsigned ld,
+		      const kernel_t **kernel, kernel_conf_t *conf )
+{
+  const int threads = omp_get_max_threads();
+  double best = 0;
+  kernel_conf_t c;
+  FILE *f;
+  int k, x, y, s;
+
+  fprintf(stderr, "Autotuning for %u x %u, %d threads\n", np, np, threads);
+
+  for (k = 0; kernels[k].name; k++) {
+    const int nx = (kernels[k].flags & KERNEL_TILE_X) ? COUNT(tune_bx) : 1;
+    const int ny = (kernels[k].flags & KERNEL_TILE_Y) ? COUNT(tune_by) : 1;
+    const int ns = (kernels[k].flags & KERNEL_STEPS) ? COUNT(tune_steps) : 1;
+
+    for (x = 0; x < nx; x++) {
+      for (y = 0; y < ny; y++) {
+	for (s = 0; s < ns; s++) {
+	  double t;
+
+	  kernel_defaults(&kernels[k], &c);
+	  if (kernels[k].flags & KERNEL_TILE_X) {
+	    // wider blocks than the grid are all the same
+	    if (x > 0 && tune_bx[x-1] >= np-2)
+	      continue;
+	    c.bx = tune_bx[x];
+	  }
+	  if (kernels[k].flags & KERNEL_TILE_Y)
+	    c.by = tune_by[y];
+	  if (kernels[k].flags & KERNEL_STEPS)
+	    c.steps = tune_steps[s];
+
+	  if ((t = tune_time(&kernels[k], &c, np, ld)) < 0) {
+	    fprintf(stderr, "Error: Cannot allocate memory\n");
+	    continue;
+	  }
+	  fprintf(stderr, "  %-8s bx %5d by %3d steps %d: %8.2f MFlop/s\n",
+		  kernels[k].name, c.bx, c.by, c.steps,
+		  (double)JACOBI_FLOP * (np-2) * (np-2) / t / 1000000);
+
+	  if (best == 0 || t < best) {
+	    best = t;
+	    *kernel = &kernels[k];
+	    *conf = c;
+	  }
+	}
+      }
+    }
+  }
+
+  // the pool of the pthreads kernel is not needed until its next call
+  stop_jacobi_pthreads();
+
+  if (best == 0) {
+    *kernel = &kernels[0];
+    kernel_defaults(*kernel, conf);
+    return;
+  }
+
+  if ((f = fopen(tunefile, "a"))) {
+    fprintf(f, "%u %u %s %d %s %d %d %d %g\n", np, ld, grid_pages_name(),
+	    threads, (*kernel)->name, conf->bx, conf->by, conf->steps, best);
+    fclose(f);
+  } else {
+    fprintf(stderr, "Warning: Cannot write tuning file \"%s\"\n", tunefile);
+  }
+}
@@ -2,18 +2,36 @@ import numpy as np
 import sys
 
 
-print '%5s %5s %5s %5s %5s\n'%('thread', 'mtime', 'stime', 'mflop', 'sflop')
-for i in [1, 2, 4, 8, 12, 16, 24, 32, 48]:
+def read_job(tag, i):
     times = []
     mflops = []
-    filename = jobname = 'job_' + sys.argv[1] + '_' + str(i) + '.out'
+    filename = jobname = 'job_' + tag + '_' + str(i) + '.out'
     with open(filename, 'r') as f:
         for l in f:
             if 'megaflops' in l:
                 mflops.append(float(l.split(':')[-1].strip()))
             elif 'Execution time' in l:
                 times.append(float(l.split(':')[-1].strip()))
+    return times, mflops
+
+
+# usage: mean_std.py <job tag> [baseline job tag]
+# with a baseline the sustained GFLOP/s of both runs and the speedup
+# over the baseline are printed as well
+baseline = sys.argv[2] if len(sys.argv) > 2 else None
+
+if baseline:
+    print '%5s %5s %5s %5s %5s %5s %5s %5s\n'%('thread', 'mtime', 'stime', 'mflop', 'sflop', 'gflop', 'gbase', 'speedup')
+else:
+    print '%5s %5s %5s %5s %5s\n'%('thread', 'mtime', 'stime', 'mflop', 'sflop')
+for i in [1, 2, 4, 8, 12, 16, 24, 32, 48]:
+    times, mflops = read_job(sys.argv[1], i)
     #print times
     #print mflops
-    print '%2d %5f %5f %5f %5f\n'%(i, np.mean(times), np.std(times), np.mean(mflops), np.std(mflops))
-
+    if baseline:
+        btimes, bmflops = read_job(baseline, i)
+        print '%2d %5f %5f %5f %5f %5f %5f %5f\n'%(i, np.mean(times), np.std(times), np.mean(mflops), np.std(mflops),
+                                                  np.mean(mflops) / 1000, np.mean(bmflops) / 1000,
+                                                  np.mean(btimes) / np.mean(times))
+    else:
+        print '%2d %5f %5f %5f %5f\n'%(i, np.mean(times), np.std(times), np.mean(mflops), np.std(mflops))
@@ -11,83 +11,32 @@
 #include <stdio.h>
 #include <math.h>
 #include <float.h>
+#include <string.h>
 #include <omp.h>
 
 #include "heat.h"
 
 /*
- * Initialize the iterative solver
- * - allocate memory for matrices
- * - set boundary conditions according to configuration
+ * Add v to point k of u, or of uf for float grids
  */
-int initialize( algoparam_t *param )
+static void add_heat( double *u, float *uf, int k, double v )
+{
+    if( u )
+	u[k] += v;
+    else
+	uf[k] += v;
+}
+
+/*
+ * Add the heat sources to the boundary of u (or uf), which has to be
+ * zero there; rows are ld points apart
+ */
+static void set_boundary( algoparam_t *param, double *u, float *uf, int np,
+			  int ld )
 {
     int i, j;
     double dist;
 
-    // total number of points (including border)
-    const int np = param->act_res + 2;
-
-    //
-    // allocate memory
-    //
-    (param->u)     = (double*)malloc( sizeof(double)* np*np );
-    (param->uhelp) = (double*)malloc( sizeof(double)* np*np );
-    (param->uvis)  = (double*)calloc( sizeof(double),
-				      (param->visres+2) *
-				      (param->visres+2) );
-    (param->diffs)  = (double*)calloc( sizeof(double), np * np);
-#ifndef BLOCKED
-    {
-#pragma omp parallel for firstprivate(j, np)
-    for (i=0;i<np;i++){
-    	for (j=0;j<np;j++){
-    		param->u[i*np+j]=0;
-		param->uhelp[i*np+j]=0;
-    	}
-    }
-    }
-#endif
-
-#ifdef BLOCKED
-    {
-      const int numx = (np-2) / BLOCK_SIZEX;
-      const int numy = (np-2) / BLOCK_SIZEY;
-      const int xrem = (np-2) % BLOCK_SIZEX;
-      const int yrem = (np-2) % BLOCK_SIZEY;
-      int b;
-#pragma omp parallel for firstprivate(j, np)
-      for (b = 0; b < numx * numy; b++) {
-	int by = b / numx;
-	int bx = b % numx;
-	int startx = 1 + bx * BLOCK_SIZEX;
-	int starty = 1 + by * BLOCK_SIZEY;
-	int endx = startx + BLOCK_SIZEX + (int)(bx == (numx-1)) * xrem;
-	int endy = starty + BLOCK_SIZEY + (int)(by == (numy-1)) * yrem;
-	int i, j;
-	for (i = starty; i < endy; i++) {
-	  int ii = i*np;
-	  int iim1=(i-1)*np;
-	  int iip1=(i+1)*np;
-	  for (j = startx; j < endx; j++) {
-	    param->uhelp[ii + j] = 0;
-	    param->u[ii + j] = 0;
-	    //u[ ii+(j-1) ] = 0;
-	    // u[ ii+(j+1) ] = 0;
-	    //u[ iim1+j ] = 0;
-	    
-	  }
-	}
-      }
-    }
-#endif
-
-    if( !(param->u) || !(param->uhelp) || !(param->uvis) )
-    {
-	fprintf(stderr, "Error: Cannot allocate memory\n");
-	return 0;
-    }
-
     for( i=0; i<param->numsrcs; i++ )
     {
 	/* top row */
@@ -99,10 +48,10 @@ int initialize( algoparam_t *param )
 
 	    if( dist <= param->heatsrcs[i].range )
 	    {
-		(param->u)[j] +=
+		add_heat(u, uf, j,
 		    (param->heatsrcs[i].range-dist) /
 		    param->heatsrcs[i].range *
-		    param->heatsrcs[i].temp;
+		    param->heatsrcs[i].temp);
 	    }
 	}
 
@@ -115,10 +64,10 @@ int initialize( algoparam_t *param )
 
 	    if( dist <= param->heatsrcs[i].range )
 	    {
-		(param->u)[(np-1)*np+j]+=
+		add_heat(u, uf, (np-1)*ld+j,
 		    (param->heatsrcs[i].range-dist) /
 		    param->heatsrcs[i].range *
-		    param->heatsrcs[i].temp;
+		    param->heatsrcs[i].temp);
 	    }
 	}
 
@@ -131,10 +80,10 @@ int initialize( algoparam_t *param )
 
 	    if( dist <= param->heatsrcs[i].range )
 	    {
-		(param->u)[ j*np ]+=
+		add_heat(u, uf, j*ld,
 		    (param->heatsrcs[i].range-dist) /
 		    param->heatsrcs[i].range *
-		    param->heatsrcs[i].temp;
+		    param->heatsrcs[i].temp);
 	    }
 	}
 
@@ -147,32 +96,167 @@ int initialize( algoparam_t *param )
 
 	    if( dist <= param->heatsrcs[i].range )
 	    {
-		(param->u)[ j*np+(np-1) ]+=
+		add_heat(u, uf, j*ld+(np-1),
 		    (param->heatsrcs[i].range-dist) /
 		    param->heatsrcs[i].range *
-		    param->heatsrcs[i].temp;
+		    param->heatsrcs[i].temp);
 	    }
 	}
     }
+}
+
+/*
+ * Initialize the iterative solver
+ * - allocate memory for matrices
+ * - set boundary conditions according to configuration
+ */
+int initialize( algoparam_t *param )
+{
+    // total number of points (including border)
+    const int np = param->act_res + 2;
+
+    // only the Jacobi kernels know about padded rows
+    param->ld = (param->algorithm == 0 && !param->precision) ?
+	grid_stride(np, param->pad) : np;
+
+    //
+    // allocate memory
+    //
+    (param->u) = (param->uhelp) = 0;
+    (param->uf) = (param->uhelpf) = 0;
+    if( param->precision )
+    {
+	// float grids instead of the double ones
+	(param->uf)     = (float*)grid_alloc( sizeof(float)* np*np );
+	(param->uhelpf) = (float*)grid_alloc( sizeof(float)* np*np );
+	if( !(param->uf) || !(param->uhelpf) )
+	{
+	    fprintf(stderr, "Error: Cannot allocate memory\n");
+	    return 0;
+	}
+    }
+    else
+    {
+	(param->u)     = (double*)grid_alloc( sizeof(double)* np*param->ld );
+	(param->uhelp) = (double*)grid_alloc( sizeof(double)* np*param->ld );
+	if( !(param->u) || !(param->uhelp) )
+	{
+	    fprintf(stderr, "Error: Cannot allocate memory\n");
+	    return 0;
+	}
+    }
+    (param->uvis)  = (double*)calloc( sizeof(double),
+				      (param->visres+2) *
+				      (param->visres+2) );
+    (param->diffs)  = (double*)calloc( sizeof(double), np * np);
+    (param->red) = 0;
+    (param->black) = 0;
+    if( param->algorithm == 1 )
+    {
+	// red and black points, (np+1)/2 per row each
+	(param->red)   = (double*)malloc( sizeof(double)* np*((np+1)/2) );
+	(param->black) = (double*)malloc( sizeof(double)* np*((np+1)/2) );
+	if( !(param->red) || !(param->black) )
+	{
+	    fprintf(stderr, "Error: Cannot allocate memory\n");
+	    return 0;
+	}
+    }
+    (param->owner) = 0;
+    if( param->numa )
+    {
+	(param->owner) = (int*)malloc( sizeof(int)*
+				       ((np*param->ld + OWNER_BLOCK-1) / OWNER_BLOCK) );
+	if( !(param->owner) )
+	{
+	    fprintf(stderr, "Error: Cannot allocate memory\n");
+	    return 0;
+	}
+    }
+
+    if( !(param->uvis) )
+    {
+	fprintf(stderr, "Error: Cannot allocate memory\n");
+	return 0;
+    }
+
+    // first touch with the partition of the kernel that will run
+    if( param->precision )
+	touch_jacobi_float(param->uf, param->uhelpf, np, np);
+    else if( param->kernel )
+	param->kernel->touch(param->u, param->uhelp, np, np, param->ld,
+			     &param->kconf, param->owner);
+    else
+	kernel_find("plain")->touch(param->u, param->uhelp, np, np, param->ld,
+				    &param->kconf, param->owner);
+
+    set_boundary(param, param->u, param->uf, np, param->ld);
 
     return 1;
 }
 
+/*
+ * Replace the float grids by double ones with the same values, the
+ * boundary is set up again in double precision. Never holds more
+ * memory than two double grids.
+ */
+int grid_to_double( algoparam_t *param )
+{
+    const int np = param->act_res + 2;
+    const kernel_t *kernel = param->kernel ? param->kernel : kernel_find("plain");
+    int i;
+
+    grid_free(param->uhelpf);
+    param->uhelpf = 0;
+    (param->u) = (double*)grid_alloc( sizeof(double)* np*np );
+    if( !(param->u) )
+    {
+	fprintf(stderr, "Error: Cannot allocate memory\n");
+	return 0;
+    }
+    kernel->touch(param->u, param->u, np, np, np, &param->kconf, 0);
+
+#pragma omp parallel for
+    for( i=1; i<np-1; i++ )
+    {
+	int j;
+	for( j=1; j<np-1; j++ )
+	    param->u[i*np+j] = param->uf[i*np+j];
+    }
+    grid_free(param->uf);
+    param->uf = 0;
+    set_boundary(param, param->u, 0, np, np);
+
+    (param->uhelp) = (double*)grid_alloc( sizeof(double)* np*np );
+    if( !(param->uhelp) )
+    {
+	fprintf(stderr, "Error: Cannot allocate memory\n");
+	return 0;
+    }
+    kernel->touch(param->uhelp, param->uhelp, np, np, np, &param->kconf, 0);
+    memcpy(param->uhelp, param->u, sizeof(double)* np*np);
+    return 1;
+}
+
 /*
  * free used memory
  */
 int finalize( algoparam_t *param )
 {
     if( param->u ) {
-	free(param->u);
+	grid_free(param->u);
 	param->u = 0;
     }
 
     if( param->uhelp ) {
-	free(param->uhelp);
+	grid_free(param->uhelp);
 	param->uhelp = 0;
     }
 
+    grid_free(param->uf);
+    grid_free(param->uhelpf);
+    param->uf = param->uhelpf = 0;
+
     if( param->uvis ) {
 	free(param->uvis);
 	param->uvis = 0;
@@ -183,79 +267,158 @@ int finalize( algoparam_t *param )
       param->diffs = 0;
     }
 
+    if( param->red ) {
+	free(param->red);
+	param->red = 0;
+    }
+
+    if( param->owner ) {
+	free(param->owner);
+	param->owner = 0;
+    }
+
+    if( param->black ) {
+	free(param->black);
+	param->black = 0;
+    }
+
     return 1;
 }
 
 
 /*
- * write the given temperature u matrix to rgb values
- * and write the resulting image to file f
+ * RGB table of the images, blue (cold) to red (hot)
  */
-void write_image( FILE * f, double *u,
-		  unsigned sizex, unsigned sizey )
+static void image_colours( unsigned char rgb[1024][3] )
 {
-    // RGB table
-    unsigned char r[1024], g[1024], b[1024];
-    int i, j, k;
-
-    double min, max;
-
-    j=1023;
+    int i, j=1023;
 
-    // prepare RGB table
-    for( i=0; i<256; i++ )
+    for( i=0; i<256; i++, j-- )
     {
-	r[j]=255; g[j]=i; b[j]=0;
-	j--;
+	rgb[j][0]=255; rgb[j][1]=i; rgb[j][2]=0;
     }
-    for( i=0; i<256; i++ )
+    for( i=0; i<256; i++, j-- )
     {
-	r[j]=255-i; g[j]=255; b[j]=0;
-	j--;
+	rgb[j][0]=255-i; rgb[j][1]=255; rgb[j][2]=0;
     }
-    for( i=0; i<256; i++ )
+    for( i=0; i<256; i++, j-- )
     {
-	r[j]=0; g[j]=255; b[j]=i;
-	j--;
+	rgb[j][0]=0; rgb[j][1]=255; rgb[j][2]=i;
     }
-    for( i=0; i<256; i++ )
+    for( i=0; i<256; i++, j-- )
     {
-	r[j]=0; g[j]=255-i; b[j]=255;
-	j--;
+	rgb[j][0]=0; rgb[j][1]=255-i; rgb[j][2]=255;
     }
+}
+
+/*
+ * write the given temperature u matrix to rgb values
+ * and write the resulting image to file f
+ *
+ * format IMAGE_P6 (binary colour), IMAGE_P5 (binary grey) or
+ * IMAGE_P3 (ASCII colour, as before). The binary formats map
+ * IMAGE_ROWS rows at a time in parallel into one buffer and write
+ * it with a single fwrite.
+ */
+void write_image( FILE * f, double *u,
+		  unsigned sizex, unsigned sizey, int format )
+{
+    unsigned char rgb[1024][3];
+    const int channels = (format == IMAGE_P5) ? 1 : 3;
+    unsigned char *buf;
+    double min, max, scale;
+    int i, i0;
+
+    image_colours(rgb);
 
     min=DBL_MAX;
     max=-DBL_MAX;
 
     // find minimum and maximum
+#pragma omp parallel for reduction(min:min) reduction(max:max)
     for( i=0; i<sizey; i++ )
     {
+	int j;
+#pragma omp simd reduction(min:min) reduction(max:max)
 	for( j=0; j<sizex; j++ )
 	{
-	    if( u[i*sizex+j]>max )
-		max=u[i*sizex+j];
-	    if( u[i*sizex+j]<min )
-		min=u[i*sizex+j];
+	    min = u[i*sizex+j] < min ? u[i*sizex+j] : min;
+	    max = u[i*sizex+j] > max ? u[i*sizex+j] : max;
 	}
     }
+    // a flat image has max == min
+    scale = (max > min) ? 1.0/(max-min) : 0.0;
 
+    if( format == IMAGE_P3 )
+    {
+	fprintf(f, "P3\n");
+	fprintf(f, "%u %u\n", sizex, sizey);
+	fprintf(f, "%u\n", 255);
 
-    fprintf(f, "P3\n");
-    fprintf(f, "%u %u\n", sizex, sizey);
-    fprintf(f, "%u\n", 255);
+	for( i=0; i<sizey; i++ )
+	{
+	    int j, k;
+	    for( j=0; j<sizex; j++ )
+	    {
+		k=(int)(1023.0*(u[i*sizex+j]-min)*scale);
+		fprintf(f, "%d %d %d  ", rgb[k][0], rgb[k][1], rgb[k][2]);
+	    }
+	    fprintf(f, "\n");
+	}
+	return;
+    }
 
-    for( i=0; i<sizey; i++ )
+    buf = (unsigned char*)malloc( (size_t)IMAGE_ROWS * sizex * channels );
+    if( !buf )
     {
-	for( j=0; j<sizex; j++ )
+	fprintf(stderr, "Error: Cannot allocate memory\n");
+	return;
+    }
+
+    fprintf(f, "P%d\n%u %u\n255\n", format == IMAGE_P5 ? 5 : 6, sizex, sizey);
+
+    for( i0=0; i0<sizey; i0+=IMAGE_ROWS )
+    {
+	const int rows = (sizey-i0 < IMAGE_ROWS) ? sizey-i0 : IMAGE_ROWS;
+
+#pragma omp parallel for
+	for( i=0; i<rows; i++ )
 	{
-	    k=(int)(1024.0*(u[i*sizex+j]-min)/(max-min));
-	    fprintf(f, "%d %d %d  ", r[k], g[k], b[k]);
+	    const double *row = u + (size_t)(i0+i)*sizex;
+	    unsigned char *out = buf + (size_t)i*sizex*channels;
+	    int idx[IMAGE_CHUNK];
+	    int j, jj, n;
+
+	    for( j=0; j<sizex; j+=IMAGE_CHUNK )
+	    {
+		n = (sizex-j < IMAGE_CHUNK) ? sizex-j : IMAGE_CHUNK;
+		if( channels == 1 )
+		{
+#pragma omp simd
+		    for( jj=0; jj<n; jj++ )
+			out[j+jj] = (unsigned char)(255.0*(row[j+jj]-min)*scale + 0.5);
+		    continue;
+		}
+		// table indices first, in vector registers, then the lookups
+#pragma omp simd
+		for( jj=0; jj<n; jj++ )
+		    idx[jj] = (int)(1023.0*(row[j+jj]-min)*scale);
+		for( jj=0; jj<n; jj++ )
+		{
+		    out[3*(j+jj)  ] = rgb[idx[jj]][0];
+		    out[3*(j+jj)+1] = rgb[idx[jj]][1];
+		    out[3*(j+jj)+2] = rgb[idx[jj]][2];
+		}
+	    }
 	}
-	fprintf(f, "\n");
+
+	fwrite(buf, channels, (size_t)rows*sizex, f);
     }
+
+    free(buf);
 }
 
-int coarsen( double *uold, unsigned oldx, unsigned oldy ,
+int coarsen( double *uold, unsigned oldx, unsigned oldy , unsigned oldld,
 	     double *unew, unsigned newx, unsigned newy )
 {
     int i, j, k, l, ii, jj;
@@ -289,7 +452,7 @@ int coarsen( double *uold, unsigned oldx, unsigned oldy ,
           for ( k=0; k<stepy; k++ ){
 	       	for ( l=0; l<stepx; l++ ){
 	       		if (ii+k<oldx && jj+l<oldy)
-		           temp += uold[(ii+k)*oldx+(jj+l)] ;
+		           temp += uold[(ii+k)*oldld+(jj+l)] ;
 	        }
 	      }
 	      unew[i*newx+j] = temp / (stepy*stepx);
@@ -298,3 +461,77 @@ int coarsen( double *uold, unsigned oldx, unsigned oldy ,
 
   return 1;
 }
+
+/*
+ * coarsen() of a float grid, the result of a run on float grids
+ * without refinement
+ */
+int coarsen_float( float *uold, unsigned oldx, unsigned oldy, unsigned oldld,
+		   double *unew, unsigned newx, unsigned newy )
+{
+    int i, j, k, l, ii, jj;
+
+    int stopx = newx;
+    int stopy = newy;
+    float temp;
+    float stepx = (float)oldx/(float)newx;
+    float stepy = (float)oldy/(float)newy;
+
+    if (oldx<newx){
+	stopx=oldx;
+	stepx=1.0;
+    }
+    if (oldy<newy){
+	stopy=oldy;
+	stepy=1.0;
+    }
+
+    for( i=0; i<stopy; i++ ){
+	ii=stepy*i;
+	for( j=0; j<stopx; j++ ){
+	    jj=stepx*j;
+	    temp = 0;
+	    for ( k=0; k<stepy; k++ )
+		for ( l=0; l<stepx; l++ )
+		    if (ii+k<oldx && jj+l<oldy)
+			temp += uold[(ii+k)*oldld+(jj+l)];
+	    unew[i*newx+j] = temp / (stepy*stepx);
+	}
+    }
+
+    return 1;
+}
+
+/*
+ * bilinear interpolation of the field uold (oldnp x oldnp points,
+ * boundary included, rows oldld apart) into the inner points of unew
+ * (newnp x newnp, rows newld apart), both spanning the same square;
+ * the initial guess of a resolution from the one before
+ */
+void prolongate( double *uold, unsigned oldnp, unsigned oldld,
+		 double *unew, unsigned newnp, unsigned newld )
+{
+    const int on = oldnp, nn = newnp, ol = oldld, nl = newld;
+    const double scale = (double)(on-1)/(double)(nn-1);
+    int i;
+
+#pragma omp parallel for schedule(static)
+    for( i=1; i<nn-1; i++ )
+    {
+	const double y = i*scale;
+	const int i0 = (int)y < on-2 ? (int)y : on-2;
+	const double ty = y - i0;
+	int j;
+
+	for( j=1; j<nn-1; j++ )
+	{
+	    const double x = j*scale;
+	    const int j0 = (int)x < on-2 ? (int)x : on-2;
+	    const double tx = x - j0;
+
+	    unew[i*nl+j] =
+		(1-ty) * ((1-tx)*uold[i0*ol+j0]     + tx*uold[i0*ol+j0+1]) +
+		ty     * ((1-tx)*uold[(i0+1)*ol+j0] + tx*uold[(i0+1)*ol+j0+1]);
+	}
+    }
+}
@@ -0,0 +1,187 @@
+/*
+ * numa.c
+ *
+ * Thread pinning and a report of the NUMA placement of the grids
+ *
+ * Linux only: the node of a cpu comes from sysfs, the node of a page
+ * from move_pages(2) without target nodes. Elsewhere pinning fails
+ * and the report says it is not available.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+#include "heat.h"
+
+#define NUMA_MAX_NODES 64
+#define NUMA_MAX_THREADS 1024
+
+#ifdef __linux__
+
+// node of a cpu, 0 if the system does not tell
+static int cpu_node( int cpu )
+{
+  char path[100];
+  int node;
+
+  for (node = 0; node < NUMA_MAX_NODES; node++) {
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d",
+	     cpu, node);
+    if (access(path, F_OK) == 0)
+      return node;
+  }
+  return 0;
+}
+
+/*
+ * Pin every OpenMP thread to one cpu of the process' affinity mask,
+ * ordered node by node. As with OMP_PROC_BIND, close puts thread t on
+ * cpu t, spread spaces the threads evenly over all cpus, which on a
+ * dual-socket node puts half of them on each socket. libgomp and the
+ * Intel runtime keep their threads between parallel regions, so the
+ * pinning holds for the rest of the run. Returns 0 for an unknown
+ * policy or if the affinity cannot be set.
+ */
+int numa_pin( const char *policy )
+{
+  const int spread = !strcmp(policy, "spread");
+  cpu_set_t mask;
+  int cpus[CPU_SETSIZE];
+  int ncpus = 0, node, c, ok = 1;
+
+  if (!spread && strcmp(policy, "close"))
+    return 0;
+  if (sched_getaffinity(0, sizeof(mask), &mask))
+    return 0;
+
+  for (node = 0; node < NUMA_MAX_NODES; node++)
+    for (c = 0; c < CPU_SETSIZE; c++)
+      if (CPU_ISSET(c, &mask) && cpu_node(c) == node)
+	cpus[ncpus++] = c;
+  if (ncpus == 0)
+    return 0;
+
+#pragma omp parallel reduction(&&:ok)
+  {
+    const int t = omp_get_thread_num();
+    const int n = omp_get_num_threads();
+    const int cpu = (spread && n <= ncpus) ? cpus[t * ncpus / n]
+					  : cpus[t % ncpus];
+    cpu_set_t one;
+
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    ok = !sched_setaffinity(0, sizeof(one), &one);
+
+#pragma omp critical
+    fprintf(stderr, "Thread %3d        : cpu %d, node %d\n",
+	    t, cpu, cpu_node(cpu));
+  }
+
+  return ok;
+}
+
+/*
+ * Print how many pages of a (n doubles) are on each node and how
+ * many of them are not on the node of the thread that first touched
+ * them (owner, see kernel_touch_t). The node of a thread is where it
+ * runs now, which is only meaningful with pinned threads.
+ */
+void numa_report( FILE *f, const char *name, double *a, size_t n,
+		  const int *owner )
+{
+  const long pagesize = sysconf(_SC_PAGESIZE);
+  const char *first = (const char*)((size_t)a & ~(size_t)(pagesize-1));
+  const size_t npages = ((const char*)(a+n) - first + pagesize-1) / pagesize;
+  int tnode[NUMA_MAX_THREADS];
+  long count[NUMA_MAX_NODES];
+  long absent = 0, remote = 0;
+  void **pages;
+  int *status;
+  size_t p;
+  int k;
+
+  for (k = 0; k < NUMA_MAX_THREADS; k++)
+    tnode[k] = -1;
+#pragma omp parallel
+  {
+    const int t = omp_get_thread_num();
+    if (t < NUMA_MAX_THREADS)
+      tnode[t] = cpu_node(sched_getcpu());
+  }
+
+  pages = (void**)malloc( sizeof(void*) * npages );
+  status = (int*)malloc( sizeof(int) * npages );
+  if (!pages || !status) {
+    fprintf(stderr, "Error: Cannot allocate memory\n");
+    free(pages);
+    free(status);
+    return;
+  }
+  for (p = 0; p < npages; p++)
+    pages[p] = (void*)(first + p * pagesize);
+
+  if (syscall(SYS_move_pages, 0, (unsigned long)npages, pages, NULL,
+	      status, 0)) {
+    fprintf(f, "%-18s: page placement not available\n", name);
+    free(pages);
+    free(status);
+    return;
+  }
+
+  for (k = 0; k < NUMA_MAX_NODES; k++)
+    count[k] = 0;
+  for (p = 0; p < npages; p++) {
+    if (status[p] < 0 || status[p] >= NUMA_MAX_NODES) {
+      absent++;
+      continue;
+    }
+    count[status[p]]++;
+    if (owner) {
+      // element at the start of the page (or of a)
+      const char *start = first + p * pagesize;
+      size_t e = start < (const char*)a ? 0 :
+	(size_t)(start - (const char*)a) / sizeof(double);
+      int t = owner[e / OWNER_BLOCK];
+      if (t >= 0 && t < NUMA_MAX_THREADS && tnode[t] >= 0 &&
+	  tnode[t] != status[p])
+	remote++;
+    }
+  }
+
+  fprintf(f, "%-18s: %ld pages", name, (long)npages);
+  for (k = 0; k < NUMA_MAX_NODES; k++)
+    if (count[k])
+      fprintf(f, ", node %d: %ld", k, count[k]);
+  if (absent)
+    fprintf(f, ", not present: %ld", absent);
+  if (owner)
+    fprintf(f, ", not on the node of their thread: %ld", remote);
+  fprintf(f, "\n");
+
+  free(pages);
+  free(status);
+}
+
+#else
+
+int numa_pin( const char *policy )
+{
+  return 0;
+}
+
+void numa_report( FILE *f, const char *name, double *a, size_t n,
+		  const int *owner )
+{
+  fprintf(f, "%-18s: page placement not available\n", name);
+}
+
+#endif
@@ -0,0 +1,199 @@
+/*
+ * relax_gauss.c
+ *
+ * Gauss-Seidel Relaxation
+ *
+ */
+
+#include <stdlib.h>
+#include <omp.h>
+#include "heat.h"
+
+/*
+ * Residual (length of error vector)
+ * between current solution and next after a Gauss-Seidel step
+ *
+ * Temporary array utmp needed to not change current solution
+ *
+ * Flop count in inner body is 7
+ */
+
+double residual_gauss(double *u, double *utmp, unsigned sizex, unsigned sizey) {
+	unsigned i, j;
+	double unew, diff, sum = 0.0;
+
+	// first row (boundary condition) into utmp
+	for (j = 1; j < sizex - 1; j++)
+		utmp[0 * sizex + j] = u[0 * sizex + j];
+	// first column (boundary condition) into utmp
+	for (i = 1; i < sizey - 1; i++)
+		utmp[i * sizex + 0] = u[i * sizex + 0];
+
+	for (j = 1; j < sizex - 1; j++) {
+		for (i = 1; i < sizey - 1; i++) {
+			unew = 0.25 * (utmp[i * sizex + (j - 1)] +  // new left
+						u[i * sizex + (j + 1)] +  // right
+						utmp[(i - 1) * sizex + j] +  // new top
+						u[(i + 1) * sizex + j]); // bottom
+
+			diff = unew - u[i * sizex + j];
+			sum += diff * diff;
+
+			utmp[i * sizex + j] = unew;
+		}
+	}
+
+	return sum;
+}
+
+/*
+ * One Gauss-Seidel iteration step
+ *
+ * Flop count in inner body is 4
+ */
+void relax_gauss(double *u, unsigned sizex, unsigned sizey) {
+	unsigned i, j;
+
+	for (j = 1; j < sizex - 1; j++) {
+		for (i = 1; i < sizey - 1; i++) {
+			u[i * sizex + j] = 0.25 * (u[i * sizex + (j - 1)] + u[i * sizex + (j + 1)] + u[(i - 1) * sizex + j] + u[(i + 1) * sizex + j]);
+		}
+	}
+}
+
+
+/*
+ * Tiled Gauss-Seidel as OpenMP tasks
+ *
+ * A point needs the new values of its left and upper neighbour and
+ * the old values of its right and lower neighbour, so a tile can run
+ * once the tiles to its left and above are done in this sweep and
+ * the tiles to its right and below are done in the previous one.
+ * These are exactly the depend clauses below (one dummy element per
+ * tile, with a frame of unused elements around it), which makes the
+ * tiles of one sweep run as a diagonal wavefront and lets the next
+ * sweeps follow right behind. Every point sees the same values as in
+ * the sequential code, so the results are bit for bit identical.
+ */
+
+#define TILE_DEP(bi, bj) dep[(bi) * (nbx+2) + (bj)]
+
+static void gauss_tile(double *u, unsigned sizex, int bi, int bj,
+		       unsigned sizey) {
+	const int i0 = 1 + (bi - 1) * GTILE_SIZEY;
+	const int j0 = 1 + (bj - 1) * GTILE_SIZEX;
+	const int i1 = i0 + GTILE_SIZEY < sizey - 1 ? i0 + GTILE_SIZEY : sizey - 1;
+	const int j1 = j0 + GTILE_SIZEX < sizex - 1 ? j0 + GTILE_SIZEX : sizex - 1;
+	int i, j;
+
+	for (i = i0; i < i1; i++) {
+		for (j = j0; j < j1; j++) {
+			u[i * sizex + j] = 0.25 * (u[i * sizex + (j - 1)] + u[i * sizex + (j + 1)] + u[(i - 1) * sizex + j] + u[(i + 1) * sizex + j]);
+		}
+	}
+}
+
+static double gauss_residual_tile(double *u, double *utmp, unsigned sizex,
+				  int bi, int bj, unsigned sizey) {
+	const int i0 = 1 + (bi - 1) * GTILE_SIZEY;
+	const int j0 = 1 + (bj - 1) * GTILE_SIZEX;
+	const int i1 = i0 + GTILE_SIZEY < sizey - 1 ? i0 + GTILE_SIZEY : sizey - 1;
+	const int j1 = j0 + GTILE_SIZEX < sizex - 1 ? j0 + GTILE_SIZEX : sizex - 1;
+	double unew, diff, sum = 0.0;
+	int i, j;
+
+	for (i = i0; i < i1; i++) {
+		for (j = j0; j < j1; j++) {
+			unew = 0.25 * (utmp[i * sizex + (j - 1)] +  // new left
+						u[i * sizex + (j + 1)] +  // right
+						utmp[(i - 1) * sizex + j] +  // new top
+						u[(i + 1) * sizex + j]); // bottom
+
+			diff = unew - u[i * sizex + j];
+			sum += diff * diff;
+
+			utmp[i * sizex + j] = unew;
+		}
+	}
+	return sum;
+}
+
+/*
+ * nsweeps Gauss-Seidel iteration steps, pipelined
+ */
+void relax_gauss_tasks(double *u, unsigned sizex, unsigned sizey, int nsweeps) {
+	const int nbx = (sizex - 2 + GTILE_SIZEX - 1) / GTILE_SIZEX;
+	const int nby = (sizey - 2 + GTILE_SIZEY - 1) / GTILE_SIZEY;
+	char *dep = (char *) calloc((nbx + 2) * (nby + 2), 1);
+	int s, bi, bj;
+
+	// without the dependence array the sweeps run one after another
+	if (!dep) {
+		fprintf(stderr, "Error: Cannot allocate memory\n");
+		for (s = 0; s < nsweeps; s++)
+			relax_gauss(u, sizex, sizey);
+		return;
+	}
+
+#pragma omp parallel
+#pragma omp single
+	for (s = 0; s < nsweeps; s++) {
+		for (bi = 1; bi <= nby; bi++) {
+			for (bj = 1; bj <= nbx; bj++) {
+#pragma omp task firstprivate(bi, bj) \
+	depend(in: TILE_DEP(bi - 1, bj), TILE_DEP(bi, bj - 1), \
+		   TILE_DEP(bi + 1, bj), TILE_DEP(bi, bj + 1)) \
+	depend(inout: TILE_DEP(bi, bj))
+				gauss_tile(u, sizex, bi, bj, sizey);
+			}
+		}
+	}
+
+	free(dep);
+}
+
+/*
+ * Same as residual_gauss; the tile sums are added up in tile
+ * order, so the result does not depend on the number of threads.
+ */
+double residual_gauss_tasks(double *u, double *utmp, unsigned sizex, unsigned sizey) {
+	const int nbx = (sizex - 2 + GTILE_SIZEX - 1) / GTILE_SIZEX;
+	const int nby = (sizey - 2 + GTILE_SIZEY - 1) / GTILE_SIZEY;
+	char *dep = (char *) calloc((nbx + 2) * (nby + 2), 1);
+	double *sums = (double *) calloc(nbx * nby, sizeof(double));
+	double sum = 0.0;
+	unsigned i, j;
+	int bi, bj;
+
+	if (!dep || !sums) {
+		fprintf(stderr, "Error: Cannot allocate memory\n");
+		free(dep);
+		free(sums);
+		return residual_gauss(u, utmp, sizex, sizey);
+	}
+
+	// first row (boundary condition) into utmp
+	for (j = 1; j < sizex - 1; j++)
+		utmp[0 * sizex + j] = u[0 * sizex + j];
+	// first column (boundary condition) into utmp
+	for (i = 1; i < sizey - 1; i++)
+		utmp[i * sizex + 0] = u[i * sizex + 0];
+
+#pragma omp parallel
+#pragma omp single
+	for (bi = 1; bi <= nby; bi++) {
+		for (bj = 1; bj <= nbx; bj++) {
+#pragma omp task firstprivate(bi, bj) \
+	depend(in: TILE_DEP(bi - 1, bj), TILE_DEP(bi, bj - 1)) \
+	depend(out: TILE_DEP(bi, bj))
+			sums[(bi - 1) * nbx + (bj - 1)] = gauss_residual_tile(u, utmp, sizex, bi, bj, sizey);
+		}
+	}
+
+	for (bi = 0; bi < nbx * nby; bi++)
+		sum += sums[bi];
+
+	free(sums);
+	free(dep);
+	return sum;
+}
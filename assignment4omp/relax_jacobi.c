@@ -5,12 +5,45 @@
  *
  */
 
+#include <stdlib.h>
 #include <omp.h>
 #include "heat.h"
 
+static double jacobi_rows( double *u, double *utmp, unsigned sizex,
+			   unsigned ld, int lo, int hi, int residual );
+
+/*
+ * Residual (length of error vector)
+ * between current solution and next after a Jacobi step
+ */
+double residual_jacobi( double *u, unsigned sizex, unsigned sizey,
+			unsigned ld )
+{
+  double sum=0.0;
+  int i;
+
+#pragma omp parallel for reduction(+:sum)
+  for( i=1; i<sizey-1; i++ ) {
+    int ii=i*ld;
+    int iim1=(i-1)*ld;
+    int iip1=(i+1)*ld;
+    int j;
+#pragma ivdep
+    for (j = 1; j < sizex-1; j++) {
+      double unew = 0.25 * (u[ ii+(j-1) ]+
+			    u[ ii+(j+1) ]+
+			    u[ iim1+j ]+
+			    u[ iip1+j ]);
+      double diff = unew - u[ii + j];
+      sum += diff * diff;
+    }
+  }
+  return(sum);
+}
+
 
 double relax_jacobi( double **u1, double **utmp1, double *diffs,
-         unsigned sizex, unsigned sizey )
+         unsigned sizex, unsigned sizey, unsigned ld, int residual )
 {
   int i, j;
   double *help,*u, *utmp,factor=0.5;
@@ -19,11 +52,22 @@ double relax_jacobi( double **u1, double **utmp1, double *diffs,
   u=*u1;
   double unew, diff, sum=0.0, temp;
 
-#pragma omp parallel for firstprivate(sizey, j, unew, diff, sizex) reduction(+:sum)
+  // the same sweep without the reduction
+  if (!residual) {
+#pragma omp parallel for
+    for( i=1; i<sizey-1; i++ )
+      jacobi_rows(u, utmp, sizex, ld, i, i+1, 0);
+
+    *u1=utmp;
+    *utmp1=u;
+    return(0);
+  }
+
+#pragma omp parallel for firstprivate(sizey, j, unew, diff, sizex, ld) reduction(+:sum)
   for( i=1; i<sizey-1; i++ ) {
-  	int ii=i*sizex;
-  	int iim1=(i-1)*sizex;
-  	int iip1=(i+1)*sizex;
+  	int ii=i*ld;
+  	int iim1=(i-1)*ld;
+  	int iip1=(i+1)*ld;
 #pragma ivdep
 	for (j = 1; j < sizex-1; j++) {
 	  unew = 0.25 * (u[ ii+(j-1) ]+
@@ -44,7 +88,8 @@ double relax_jacobi( double **u1, double **utmp1, double *diffs,
 
 
 double relax_jacobi_blocked(double **u1, double **utmp1,
-			    unsigned sizex, unsigned sizey)
+			    unsigned sizex, unsigned sizey, unsigned ld,
+			    int bx, int by, int residual)
 {
   double *help,*u, *utmp,factor=0.5;
 
@@ -52,24 +97,35 @@ double relax_jacobi_blocked(double **u1, double **utmp1,
   u=*u1;
   double unew, diff, sum=0.0, temp;
 
-  const int numx = (sizex-2) / BLOCK_SIZEX;
-  const int numy = (sizey-2) / BLOCK_SIZEY;
-  const int xrem = (sizex-2) % BLOCK_SIZEX;
-  const int yrem = (sizey-2) % BLOCK_SIZEY;
+  // blocks larger than the grid would leave numx or numy at 0
+  const int sx = bx < (int)sizex-2 ? bx : (int)sizex-2;
+  const int sy = by < (int)sizey-2 ? by : (int)sizey-2;
+  const int numx = (sizex-2) / sx;
+  const int numy = (sizey-2) / sy;
+  const int xrem = (sizex-2) % sx;
+  const int yrem = (sizey-2) % sy;
   int b;
 #pragma omp parallel for firstprivate(unew, diff) reduction(+:sum)
   for (b = 0; b < numx * numy; b++) {
     int by = b / numx;
     int bx = b % numx;
-    int starty = 1 + by * BLOCK_SIZEY;
-    int startx = 1 + bx * BLOCK_SIZEX;
-    int endx = startx + BLOCK_SIZEX + (int)(bx == (numx-1)) * xrem;
-    int endy = starty + BLOCK_SIZEY + (int)(by == (numy-1)) * yrem;
+    int starty = 1 + by * sy;
+    int startx = 1 + bx * sx;
+    int endx = startx + sx + (int)(bx == (numx-1)) * xrem;
+    int endy = starty + sy + (int)(by == (numy-1)) * yrem;
     int i, j;
     for (i = starty; i < endy; i++) {
-      int ii = i*sizex;
-      int iim1=(i-1)*sizex;
-      int iip1=(i+1)*sizex;
+      int ii = i*ld;
+      int iim1=(i-1)*ld;
+      int iip1=(i+1)*ld;
+      if (!residual) {
+	for (j = startx; j < endx; j++)
+	  utmp[ii + j] = 0.25 * (u[ ii+(j-1) ]+
+				 u[ ii+(j+1) ]+
+				 u[ iim1+j ]+
+				 u[ iip1+j ]);
+	continue;
+      }
       for (j = startx; j < endx; j++) {
 	unew = 0.25 * (u[ ii+(j-1) ]+
 			 u[ ii+(j+1) ]+
@@ -88,3 +144,293 @@ double relax_jacobi_blocked(double **u1, double **utmp1,
 
 
     
+
+
+/*
+ * Time-skewed Jacobi: advances nsteps sweeps per call.
+ *
+ * The grid is cut into bands of 'height' rows. A band does all
+ * nsteps sweeps before the next band is touched by the same thread;
+ * sweep t of band k covers the rows of band k shifted up by t-1,
+ * so it only needs rows of sweep t-1 that are still in cache.
+ * Band k may start sweep t once band k-1 has finished sweep t-1,
+ * bands are dealt out round robin and each band publishes its
+ * progress in done[], which gives a pipelined wavefront without
+ * barriers between the sweeps.
+ *
+ * Every point gets exactly the same update as in relax_jacobi,
+ * so u is bit for bit identical. The residual is that of the
+ * last sweep.
+ */
+double relax_jacobi_tblocked( double **u1, double **utmp1,
+			      unsigned sizex, unsigned sizey, unsigned ld,
+			      int height, int nsteps, int residual )
+{
+  double *buf[2];
+  double sum=0.0;
+  int *done;
+
+  int numy;
+  int k;
+
+  // a band has to be at least two rows high, otherwise a sweep of
+  // band k could overwrite rows band k-2 still has to read
+  if (height < 2)
+    height = 2;
+  numy = (sizey-2) / height;
+  if (numy < 1)
+    numy = 1;
+
+  buf[0]=*u1;
+  buf[1]=*utmp1;
+
+  done = (int*)malloc( sizeof(int) * numy );
+  for (k = 0; k < numy; k++)
+    done[k] = 0;
+
+#pragma omp parallel reduction(+:sum)
+  {
+    const int nthreads = omp_get_num_threads();
+    int b, t, i, j, prev;
+
+    for (b = omp_get_thread_num(); b < numy; b += nthreads) {
+      const int starty = 1 + b * height;
+      const int endy = (b == numy-1) ? (int)sizey-1 : starty + height;
+
+      for (t = 1; t <= nsteps; t++) {
+	double *u = buf[(t-1) & 1];
+	double *utmp = buf[t & 1];
+	int lo = starty - t + 1;
+	int hi = endy - t + 1;
+
+	if (lo < 1)
+	  lo = 1;
+	if (b == numy-1)
+	  hi = sizey-1;
+	else if (hi < 1)
+	  hi = 1;
+
+	// wait until the band above has finished sweep t-1
+	if (b > 0) {
+	  do {
+#pragma omp atomic read
+	    prev = done[b-1];
+	  } while (prev < t-1);
+#pragma omp flush
+	}
+
+	for (i = lo; i < hi; i++) {
+	  int ii=i*ld;
+	  int iim1=(i-1)*ld;
+	  int iip1=(i+1)*ld;
+	  if (residual && t == nsteps) {
+#pragma ivdep
+	    for (j = 1; j < sizex-1; j++) {
+	      double unew = 0.25 * (u[ ii+(j-1) ]+
+				    u[ ii+(j+1) ]+
+				    u[ iim1+j ]+
+				    u[ iip1+j ]);
+	      double diff = unew - u[ii + j];
+	      utmp[ii + j] = unew;
+	      sum += diff * diff;
+	    }
+	  } else {
+#pragma ivdep
+	    for (j = 1; j < sizex-1; j++) {
+	      utmp[ii + j] = 0.25 * (u[ ii+(j-1) ]+
+				     u[ ii+(j+1) ]+
+				     u[ iim1+j ]+
+				     u[ iip1+j ]);
+	    }
+	  }
+	}
+
+#pragma omp flush
+#pragma omp atomic write
+	done[b] = t;
+      }
+    }
+  }
+
+  free(done);
+
+  // the result of sweep nsteps lives in buf[nsteps & 1]
+  *u1=buf[nsteps & 1];
+  *utmp1=buf[(nsteps+1) & 1];
+  return(sum);
+}
+
+
+// one sweep over rows lo..hi-1, with the residual if asked for
+static double jacobi_rows( double *u, double *utmp, unsigned sizex,
+			   unsigned ld, int lo, int hi, int residual )
+{
+  int i, j;
+  double sum=0.0;
+
+  for (i = lo; i < hi; i++) {
+    int ii=i*ld;
+    int iim1=(i-1)*ld;
+    int iip1=(i+1)*ld;
+    if (residual) {
+#pragma ivdep
+      for (j = 1; j < sizex-1; j++) {
+	double unew = 0.25 * (u[ ii+(j-1) ]+
+			      u[ ii+(j+1) ]+
+			      u[ iim1+j ]+
+			      u[ iip1+j ]);
+	double diff = unew - u[ii + j];
+	utmp[ii + j] = unew;
+	sum += diff * diff;
+      }
+    } else {
+#pragma ivdep
+      for (j = 1; j < sizex-1; j++) {
+	utmp[ii + j] = 0.25 * (u[ ii+(j-1) ]+
+			       u[ ii+(j+1) ]+
+			       u[ iim1+j ]+
+			       u[ iip1+j ]);
+      }
+    }
+  }
+  return(sum);
+}
+
+/*
+ * Diamond-tiled Jacobi: advances nsteps sweeps per call with
+ * two barriers instead of one per sweep.
+ *
+ * The rows are cut into bands of at least 2*nsteps rows. In the
+ * first phase every band runs all sweeps on a region that shrinks
+ * by one row per sweep on each side facing another band (an
+ * upright trapezoid), so bands are independent. In the second
+ * phase the gaps around each band border are filled sweep by sweep
+ * with a region that grows by one row per sweep (an inverted
+ * trapezoid). An inverted trapezoid together with the upright one
+ * of the next call forms the diamond. The values read from the
+ * first phase are never overwritten before they are used, so two
+ * buffers are enough and u ends up bit for bit as in relax_jacobi.
+ */
+double relax_jacobi_diamond( double **u1, double **utmp1,
+			     unsigned sizex, unsigned sizey, unsigned ld,
+			     int height, int nsteps, int residual )
+{
+  double *buf[2];
+  double sum=0.0;
+  int numy, b;
+
+  if (height < 2*nsteps)
+    height = 2*nsteps;
+  numy = (sizey-2) / height;
+  if (numy < 1)
+    numy = 1;
+
+  buf[0]=*u1;
+  buf[1]=*utmp1;
+
+#pragma omp parallel reduction(+:sum)
+  {
+    int t;
+
+    // upright trapezoids, one per band
+#pragma omp for schedule(static)
+    for (b = 0; b < numy; b++) {
+      const int starty = 1 + b * height;
+      const int endy = (b == numy-1) ? (int)sizey-1 : starty + height;
+
+      for (t = 1; t <= nsteps; t++) {
+	int lo = (b == 0) ? 1 : starty + t - 1;
+	int hi = (b == numy-1) ? endy : endy - t + 1;
+	sum += jacobi_rows(buf[(t-1) & 1], buf[t & 1], sizex, ld,
+			   lo, hi, residual && t == nsteps);
+      }
+    }
+
+    // inverted trapezoids, one per border between two bands
+#pragma omp for schedule(static)
+    for (b = 1; b < numy; b++) {
+      const int border = 1 + b * height;
+
+      for (t = 1; t <= nsteps; t++) {
+	sum += jacobi_rows(buf[(t-1) & 1], buf[t & 1], sizex, ld,
+			   border - t + 1, border + t - 1, residual && t == nsteps);
+      }
+    }
+  }
+
+  *u1=buf[nsteps & 1];
+  *utmp1=buf[(nsteps+1) & 1];
+  return(sum);
+}
+
+
+/*
+ * Jacobi on float grids: half the memory traffic of relax_jacobi.
+ * The update is done in float, the residual is summed up in double.
+ *
+ * Flop count in inner body is 7
+ */
+double relax_jacobi_float( float **u1, float **utmp1,
+			   unsigned sizex, unsigned sizey, int residual )
+{
+  float *u, *utmp;
+  double sum=0.0;
+  int i;
+
+  utmp=*utmp1;
+  u=*u1;
+
+#pragma omp parallel for reduction(+:sum)
+  for (i = 1; i < sizey-1; i++) {
+    int ii=i*sizex;
+    int iim1=(i-1)*sizex;
+    int iip1=(i+1)*sizex;
+    int j;
+    double rsum=0.0;
+    if (!residual) {
+#pragma ivdep
+      for (j = 1; j < sizex-1; j++)
+	utmp[ii + j] = 0.25f * (u[ ii+(j-1) ]+
+				u[ ii+(j+1) ]+
+				u[ iim1+j ]+
+				u[ iip1+j ]);
+      continue;
+    }
+    // the float/double mix keeps the compiler from vectorizing
+    // the sum on its own
+#pragma omp simd reduction(+:rsum)
+    for (j = 1; j < sizex-1; j++) {
+      float unew = 0.25f * (u[ ii+(j-1) ]+
+			    u[ ii+(j+1) ]+
+			    u[ iim1+j ]+
+			    u[ iip1+j ]);
+      double diff = (double)unew - u[ii + j];
+      utmp[ii + j] = unew;
+      rsum += diff * diff;
+    }
+    sum += rsum;
+  }
+
+  *u1=utmp;
+  *utmp1=u;
+  return(sum);
+}
+
+/*
+ * First touch of the float grids with the rows of relax_jacobi_float
+ */
+void touch_jacobi_float( float *u, float *utmp,
+			 unsigned sizex, unsigned sizey )
+{
+  int i;
+
+#pragma omp parallel for
+  for (i = 1; i < sizey-1; i++) {
+    // the boundary rows go with the first and last inner row
+    int lo = (i == 1) ? 0 : i;
+    int hi = (i == sizey-2) ? sizey : i+1;
+    int j;
+    for (j = lo*sizex; j < hi*sizex; j++)
+      u[j] = utmp[j] = 0;
+  }
+}
@@ -0,0 +1,312 @@
+/*
+ * relax_jacobi_pthreads.c
+ *
+ * Jacobi on a persistent pool of POSIX threads
+ *
+ * The pool is started on first use and lives until stop_jacobi_pthreads
+ * or the end of the program.
+ * Thread t (the caller is thread 0) owns the same slab of rows in
+ * every call, first touches it and keeps its own copy of the two
+ * grid pointers, which it swaps after each sweep. A call runs nsteps
+ * sweeps with one sense-reversing spin barrier between two sweeps and
+ * one to start and end the call, instead of a fork and join of an
+ * OpenMP parallel region per sweep. A thread that spins longer than
+ * PT_SPINS sleeps on a condition variable, so an idle pool does not
+ * take the cpus from other code.
+ *
+ * The number of threads is taken from OpenMP (OMP_NUM_THREADS), and
+ * pool thread t runs on the cpus of OpenMP thread t (see numa_pin and
+ * OMP_PROC_BIND), so runs with both backends are comparable.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <omp.h>
+#include "heat.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PT_PAUSE() _mm_pause()
+#else
+#define PT_PAUSE()
+#endif
+
+// spins before a waiting thread goes to sleep
+#define PT_SPINS 100000
+
+#define PT_MAX_THREADS 256
+
+enum { PT_SWEEP, PT_TOUCH, PT_EXIT };
+
+// a cache line of its own, apart from the job read by all threads
+typedef struct
+{
+  volatile int count;
+  volatile int sense;
+  volatile int sleepers;
+  int n;
+  char pad[64 - 4*sizeof(int)];
+}
+pt_barrier_t;
+
+// only taken by the sleeping threads and the thread that wakes them
+static pthread_mutex_t pt_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pt_wake = PTHREAD_COND_INITIALIZER;
+
+// one cache line per thread for its part of the residual
+typedef struct
+{
+  double sum;
+  char pad[64 - sizeof(double)];
+}
+pt_sum_t;
+
+static struct
+{
+  int nthreads;
+  pthread_t thread[PT_MAX_THREADS];
+#ifdef __linux__
+  cpu_set_t cpus[PT_MAX_THREADS];
+#endif
+  pt_barrier_t barrier __attribute__((aligned(64)));
+  pt_sum_t sum[PT_MAX_THREADS];
+
+  // the current job, written by thread 0 before the start barrier
+  int op;
+  double *u, *utmp;
+  unsigned sizex, sizey, ld;
+  int nsteps, residual;
+  int *owner;
+}
+pool;
+
+/*
+ * thread-private sense of the barrier, every thread goes through all
+ * waits on it in the same order
+ */
+static __thread int pt_sense = 0;
+
+static void pt_barrier_wait( pt_barrier_t *b, int *sense )
+{
+  int spins = 0;
+
+  *sense = !*sense;
+  if (__sync_sub_and_fetch(&b->count, 1) == 0) {
+    b->count = b->n;
+    __sync_synchronize();
+    b->sense = *sense;
+    __sync_synchronize();
+    if (b->sleepers) {
+      pthread_mutex_lock(&pt_lock);
+      pthread_cond_broadcast(&pt_wake);
+      pthread_mutex_unlock(&pt_lock);
+    }
+  } else {
+    while (b->sense != *sense && ++spins <= PT_SPINS)
+      PT_PAUSE();
+    if (b->sense != *sense) {
+      // sleepers is raised before the sense is read again, so either
+      // the last thread sees it and wakes us or we see the new sense
+      pthread_mutex_lock(&pt_lock);
+      __sync_add_and_fetch(&b->sleepers, 1);
+      while (b->sense != *sense)
+	pthread_cond_wait(&pt_wake, &pt_lock);
+      __sync_sub_and_fetch(&b->sleepers, 1);
+      pthread_mutex_unlock(&pt_lock);
+    }
+  }
+  __sync_synchronize();
+}
+
+/*
+ * the part of the job of thread t
+ */
+static void pt_work( int t )
+{
+  const int inner = pool.sizey-2;
+  const int lo = 1 + (int)((long)t * inner / pool.nthreads);
+  const int hi = 1 + (int)((long)(t+1) * inner / pool.nthreads);
+  const unsigned sizex = pool.sizex, ld = pool.ld;
+  double *u = pool.u, *utmp = pool.utmp, *help;
+  double sum = 0.0;
+  int i, j, s;
+
+  if (pool.op == PT_TOUCH) {
+    // the boundary rows go with the first and last slab
+    const int first = (lo == 1) ? 0 : lo;
+    const int last = (hi == pool.sizey-1) ? (int)pool.sizey : hi;
+    for (i = first*ld; i < last*ld; i++)
+      u[i] = utmp[i] = 0;
+    if (pool.owner)
+      for (i = first*ld / OWNER_BLOCK; i <= (last*ld-1) / OWNER_BLOCK; i++)
+	pool.owner[i] = t;
+    return;
+  }
+
+  for (s = 1; s <= pool.nsteps; s++) {
+    for (i = lo; i < hi; i++) {
+      int ii=i*ld;
+      int iim1=(i-1)*ld;
+      int iip1=(i+1)*ld;
+      if (pool.residual && s == pool.nsteps) {
+#pragma ivdep
+	for (j = 1; j < sizex-1; j++) {
+	  double unew = 0.25 * (u[ ii+(j-1) ]+
+				u[ ii+(j+1) ]+
+				u[ iim1+j ]+
+				u[ iip1+j ]);
+	  double diff = unew - u[ii + j];
+	  utmp[ii + j] = unew;
+	  sum += diff * diff;
+	}
+      } else {
+#pragma ivdep
+	for (j = 1; j < sizex-1; j++) {
+	  utmp[ii + j] = 0.25 * (u[ ii+(j-1) ]+
+				 u[ ii+(j+1) ]+
+				 u[ iim1+j ]+
+				 u[ iip1+j ]);
+	}
+      }
+    }
+
+    help = u;
+    u = utmp;
+    utmp = help;
+
+    // the next sweep reads the rows next to the slab
+    if (s < pool.nsteps)
+      pt_barrier_wait(&pool.barrier, &pt_sense);
+  }
+  pool.sum[t].sum = sum;
+}
+
+static void *pt_worker( void *arg )
+{
+  const int t = (int)(long)arg;
+
+#ifdef __linux__
+  sched_setaffinity(0, sizeof(cpu_set_t), &pool.cpus[t]);
+#endif
+  for (;;) {
+    pt_barrier_wait(&pool.barrier, &pt_sense);
+    if (pool.op == PT_EXIT)
+      return 0;
+    pt_work(t);
+    pt_barrier_wait(&pool.barrier, &pt_sense);
+  }
+}
+
+static void pt_stop( void )
+{
+  int t;
+
+  if (pool.nthreads == 0)
+    return;
+  pool.op = PT_EXIT;
+  pt_barrier_wait(&pool.barrier, &pt_sense);
+  for (t = 1; t < pool.nthreads; t++)
+    pthread_join(pool.thread[t], 0);
+  pool.nthreads = 0;
+}
+
+static void pt_start( void )
+{
+  static int registered = 0;
+  int t;
+
+  pool.nthreads = omp_get_max_threads();
+  if (pool.nthreads > PT_MAX_THREADS)
+    pool.nthreads = PT_MAX_THREADS;
+  pool.barrier.n = pool.barrier.count = pool.nthreads;
+  pool.barrier.sense = 0;
+  pool.barrier.sleepers = 0;
+  // a new pool starts with a new sense
+  pt_sense = 0;
+
+#ifdef __linux__
+  // the pool threads inherit the cpus of this thread otherwise
+#pragma omp parallel num_threads(pool.nthreads)
+  sched_getaffinity(0, sizeof(cpu_set_t), &pool.cpus[omp_get_thread_num()]);
+  sched_setaffinity(0, sizeof(cpu_set_t), &pool.cpus[0]);
+#endif
+
+  for (t = 1; t < pool.nthreads; t++) {
+    if (pthread_create(&pool.thread[t], 0, pt_worker, (void*)(long)t)) {
+      fprintf(stderr, "Error: Cannot create thread %d\n", t);
+      exit(1);
+    }
+  }
+  if (!registered)
+    atexit(pt_stop);
+  registered = 1;
+}
+
+static void pt_run( int op, double *u, double *utmp,
+		    unsigned sizex, unsigned sizey, unsigned ld,
+		    int nsteps, int residual, int *owner )
+{
+  if (pool.nthreads == 0)
+    pt_start();
+
+  pool.op = op;
+  pool.u = u;
+  pool.utmp = utmp;
+  pool.sizex = sizex;
+  pool.sizey = sizey;
+  pool.ld = ld;
+  pool.nsteps = nsteps;
+  pool.residual = residual;
+  pool.owner = owner;
+
+  pt_barrier_wait(&pool.barrier, &pt_sense);
+  pt_work(0);
+  pt_barrier_wait(&pool.barrier, &pt_sense);
+}
+
+/*
+ * nsteps Jacobi sweeps, returns the residual of the last one
+ * (0 without residual); bit for bit the same as relax_jacobi
+ */
+double relax_jacobi_pthreads( double **u1, double **utmp1,
+			      unsigned sizex, unsigned sizey, unsigned ld,
+			      int nsteps, int residual )
+{
+  double *help, sum = 0.0;
+  int t;
+
+  pt_run(PT_SWEEP, *u1, *utmp1, sizex, sizey, ld, nsteps, residual, 0);
+
+  // in thread order, so the sum does not depend on the timing
+  for (t = 0; t < pool.nthreads; t++)
+    sum += pool.sum[t].sum;
+
+  if (nsteps & 1) {
+    help = *u1;
+    *u1 = *utmp1;
+    *utmp1 = help;
+  }
+  return(sum);
+}
+
+/*
+ * ends the pool threads, the next call starts a new pool
+ */
+void stop_jacobi_pthreads( void )
+{
+  pt_stop();
+}
+
+/*
+ * first touch of u and utmp by the pool, each thread its own slab;
+ * owner (if not 0) gets the thread of every OWNER_BLOCK
+ */
+void touch_jacobi_pthreads( double *u, double *utmp,
+			    unsigned sizex, unsigned sizey, unsigned ld,
+			    int *owner )
+{
+  pt_run(PT_TOUCH, u, utmp, sizex, sizey, ld, 0, 0, owner);
+}
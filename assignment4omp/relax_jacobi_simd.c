@@ -0,0 +1,252 @@
+/*
+ * relax_jacobi_simd.c
+ *
+ * Hand-vectorized Jacobi Relaxation
+ *
+ * One row kernel per instruction set (SSE2, AVX2, AVX-512), picked
+ * once at startup with cpuid. All kernels compute the update in the
+ * same order as relax_jacobi, so u is bit for bit identical; only the
+ * residual is summed in a different order (several accumulators).
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <omp.h>
+#include <immintrin.h>
+#include "heat.h"
+
+typedef double (*jacobi_row_t)( const double *u, double *utmp,
+				unsigned sizex, unsigned ld, int i );
+
+/*
+ * Scalar update of row i, columns [j0, j1)
+ */
+static inline double jacobi_row_scalar( const double *u, double *utmp,
+					unsigned ld, int i, int j0, int j1 )
+{
+  const int ii=i*ld;
+  const int iim1=(i-1)*ld;
+  const int iip1=(i+1)*ld;
+  double unew, diff, sum=0.0;
+  int j;
+
+  for (j = j0; j < j1; j++) {
+    unew = 0.25 * (u[ ii+(j-1) ]+
+		   u[ ii+(j+1) ]+
+		   u[ iim1+j ]+
+		   u[ iip1+j ]);
+    diff = unew - u[ii + j];
+    utmp[ii + j] = unew;
+    sum += diff * diff;
+  }
+  return(sum);
+}
+
+/*
+ * first column from which on utmp[ii+j] is aligned to 'align' bytes
+ */
+static inline int aligned_start( const double *utmp, int ii, int j0, int j1,
+				 int align )
+{
+  int j = j0;
+  while (j < j1 && ((uintptr_t)(utmp + ii + j) & (align-1)))
+    j++;
+  return(j);
+}
+
+
+static double jacobi_row_sse2( const double *u, double *utmp,
+			       unsigned sizex, unsigned ld, int i )
+{
+  const int ii=i*ld;
+  const int iim1=(i-1)*ld;
+  const int iip1=(i+1)*ld;
+  const int end = sizex-1;
+  const __m128d quarter = _mm_set1_pd(0.25);
+  __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+  double tmp[2], sum;
+  int j, j0;
+
+  j0 = aligned_start(utmp, ii, 1, end, 16);
+  sum = jacobi_row_scalar(u, utmp, ld, i, 1, j0);
+
+  for (j = j0; j + 4 <= end; j += 4) {
+    __m128d c0 = _mm_loadu_pd(u + ii + j);
+    __m128d c1 = _mm_loadu_pd(u + ii + j + 2);
+    __m128d n0 = _mm_add_pd(_mm_loadu_pd(u + ii + j - 1),
+			    _mm_loadu_pd(u + ii + j + 1));
+    __m128d n1 = _mm_add_pd(_mm_loadu_pd(u + ii + j + 1),
+			    _mm_loadu_pd(u + ii + j + 3));
+    n0 = _mm_add_pd(n0, _mm_loadu_pd(u + iim1 + j));
+    n1 = _mm_add_pd(n1, _mm_loadu_pd(u + iim1 + j + 2));
+    n0 = _mm_mul_pd(quarter, _mm_add_pd(n0, _mm_loadu_pd(u + iip1 + j)));
+    n1 = _mm_mul_pd(quarter, _mm_add_pd(n1, _mm_loadu_pd(u + iip1 + j + 2)));
+    _mm_store_pd(utmp + ii + j, n0);
+    _mm_store_pd(utmp + ii + j + 2, n1);
+    c0 = _mm_sub_pd(n0, c0);
+    c1 = _mm_sub_pd(n1, c1);
+    acc0 = _mm_add_pd(acc0, _mm_mul_pd(c0, c0));
+    acc1 = _mm_add_pd(acc1, _mm_mul_pd(c1, c1));
+  }
+
+  _mm_storeu_pd(tmp, _mm_add_pd(acc0, acc1));
+  sum += tmp[0] + tmp[1];
+  return(sum + jacobi_row_scalar(u, utmp, ld, i, j, end));
+}
+
+
+__attribute__((target("avx2,fma")))
+static double jacobi_row_avx2( const double *u, double *utmp,
+			       unsigned sizex, unsigned ld, int i )
+{
+  const int ii=i*ld;
+  const int iim1=(i-1)*ld;
+  const int iip1=(i+1)*ld;
+  const int end = sizex-1;
+  const __m256d quarter = _mm256_set1_pd(0.25);
+  __m256d acc[4];
+  double tmp[4], sum;
+  int j, j0, k;
+
+  for (k = 0; k < 4; k++)
+    acc[k] = _mm256_setzero_pd();
+
+  j0 = aligned_start(utmp, ii, 1, end, 32);
+  sum = jacobi_row_scalar(u, utmp, ld, i, 1, j0);
+
+  // four independent accumulators hide the latency of the fma chain
+  for (j = j0; j + 16 <= end; j += 16) {
+    for (k = 0; k < 4; k++) {
+      const int jj = j + 4*k;
+      __m256d c = _mm256_loadu_pd(u + ii + jj);
+      __m256d n = _mm256_add_pd(_mm256_loadu_pd(u + ii + jj - 1),
+				_mm256_loadu_pd(u + ii + jj + 1));
+      n = _mm256_add_pd(n, _mm256_loadu_pd(u + iim1 + jj));
+      n = _mm256_mul_pd(quarter,
+			_mm256_add_pd(n, _mm256_loadu_pd(u + iip1 + jj)));
+      _mm256_store_pd(utmp + ii + jj, n);
+      c = _mm256_sub_pd(n, c);
+      acc[k] = _mm256_fmadd_pd(c, c, acc[k]);
+    }
+  }
+  for (; j + 4 <= end; j += 4) {
+    __m256d c = _mm256_loadu_pd(u + ii + j);
+    __m256d n = _mm256_add_pd(_mm256_loadu_pd(u + ii + j - 1),
+			      _mm256_loadu_pd(u + ii + j + 1));
+    n = _mm256_add_pd(n, _mm256_loadu_pd(u + iim1 + j));
+    n = _mm256_mul_pd(quarter,
+		      _mm256_add_pd(n, _mm256_loadu_pd(u + iip1 + j)));
+    _mm256_store_pd(utmp + ii + j, n);
+    c = _mm256_sub_pd(n, c);
+    acc[0] = _mm256_fmadd_pd(c, c, acc[0]);
+  }
+
+  acc[0] = _mm256_add_pd(_mm256_add_pd(acc[0], acc[1]),
+			 _mm256_add_pd(acc[2], acc[3]));
+  _mm256_storeu_pd(tmp, acc[0]);
+  sum += (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+  return(sum + jacobi_row_scalar(u, utmp, ld, i, j, end));
+}
+
+
+__attribute__((target("avx512f")))
+static double jacobi_row_avx512( const double *u, double *utmp,
+				 unsigned sizex, unsigned ld, int i )
+{
+  const int ii=i*ld;
+  const int iim1=(i-1)*ld;
+  const int iip1=(i+1)*ld;
+  const int end = sizex-1;
+  const __m512d quarter = _mm512_set1_pd(0.25);
+  __m512d acc[4];
+  double sum;
+  int j, j0, k;
+
+  for (k = 0; k < 4; k++)
+    acc[k] = _mm512_setzero_pd();
+
+  j0 = aligned_start(utmp, ii, 1, end, 64);
+  sum = jacobi_row_scalar(u, utmp, ld, i, 1, j0);
+
+  for (j = j0; j + 32 <= end; j += 32) {
+    for (k = 0; k < 4; k++) {
+      const int jj = j + 8*k;
+      __m512d c = _mm512_loadu_pd(u + ii + jj);
+      __m512d n = _mm512_add_pd(_mm512_loadu_pd(u + ii + jj - 1),
+				_mm512_loadu_pd(u + ii + jj + 1));
+      n = _mm512_add_pd(n, _mm512_loadu_pd(u + iim1 + jj));
+      n = _mm512_mul_pd(quarter,
+			_mm512_add_pd(n, _mm512_loadu_pd(u + iip1 + jj)));
+      _mm512_store_pd(utmp + ii + jj, n);
+      c = _mm512_sub_pd(n, c);
+      acc[k] = _mm512_fmadd_pd(c, c, acc[k]);
+    }
+  }
+  for (; j + 8 <= end; j += 8) {
+    __m512d c = _mm512_loadu_pd(u + ii + j);
+    __m512d n = _mm512_add_pd(_mm512_loadu_pd(u + ii + j - 1),
+			      _mm512_loadu_pd(u + ii + j + 1));
+    n = _mm512_add_pd(n, _mm512_loadu_pd(u + iim1 + j));
+    n = _mm512_mul_pd(quarter,
+		      _mm512_add_pd(n, _mm512_loadu_pd(u + iip1 + j)));
+    _mm512_store_pd(utmp + ii + j, n);
+    c = _mm512_sub_pd(n, c);
+    acc[0] = _mm512_fmadd_pd(c, c, acc[0]);
+  }
+
+  acc[0] = _mm512_add_pd(_mm512_add_pd(acc[0], acc[1]),
+			 _mm512_add_pd(acc[2], acc[3]));
+  sum += _mm512_reduce_add_pd(acc[0]);
+  return(sum + jacobi_row_scalar(u, utmp, ld, i, j, end));
+}
+
+
+static jacobi_row_t jacobi_row = jacobi_row_sse2;
+
+/*
+ * Pick the widest row kernel the cpu supports. HEAT_SIMD=sse2|avx2|avx512
+ * caps the choice, e.g. to compare the kernels on one machine.
+ * Returns the name of the chosen kernel.
+ */
+const char *relax_jacobi_simd_init()
+{
+  const char *cap = getenv("HEAT_SIMD");
+  int allow_avx512 = !cap || !strcmp(cap, "avx512");
+  int allow_avx2 = allow_avx512 || !strcmp(cap, "avx2");
+
+  __builtin_cpu_init();
+
+  if (allow_avx512 && __builtin_cpu_supports("avx512f")) {
+    jacobi_row = jacobi_row_avx512;
+    return("avx512");
+  }
+  if (allow_avx2 && __builtin_cpu_supports("avx2") &&
+      __builtin_cpu_supports("fma")) {
+    jacobi_row = jacobi_row_avx2;
+    return("avx2");
+  }
+  jacobi_row = jacobi_row_sse2;
+  return("sse2");
+}
+
+
+double relax_jacobi_simd( double **u1, double **utmp1,
+			  unsigned sizex, unsigned sizey, unsigned ld )
+{
+  double *u, *utmp, sum=0.0;
+  int i;
+
+  utmp=*utmp1;
+  u=*u1;
+
+#pragma omp parallel for reduction(+:sum)
+  for (i = 1; i < sizey-1; i++)
+    sum += jacobi_row(u, utmp, sizex, ld, i);
+
+  *u1=utmp;
+  *utmp1=u;
+  return(sum);
+}
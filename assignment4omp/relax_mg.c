@@ -0,0 +1,197 @@
+/*
+ * relax_mg.c
+ *
+ * Geometric multigrid
+ *
+ * Level l has n[l] inner points per dimension, coarse point I lies
+ * on fine point 2I, so n[l+1] = (n[l]-1)/2. Every level solves
+ * 4u - (left+right+top+bottom) = f, where f already carries the h^2
+ * of that level; the finest level is the heat problem with f = 0
+ * and its boundary in u. Coarse levels solve for the error and have
+ * zero boundaries.
+ *
+ * Smoother is red-black Gauss-Seidel, restriction full weighting,
+ * prolongation bilinear; all loops are OpenMP parallel over rows.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "heat.h"
+
+/*
+ * sweeps red-black Gauss-Seidel sweeps on an n x n level
+ *
+ * Flop count in inner body is 5
+ */
+static void mg_smooth( double *u, double *f, unsigned n, int sweeps )
+{
+  const int np = n+2;
+  int s, colour, i;
+
+  for (s = 0; s < sweeps; s++) {
+    for (colour = 0; colour < 2; colour++) {
+#pragma omp parallel for schedule(static)
+      for (i = 1; i <= n; i++) {
+	int ii=i*np;
+	int j;
+	for (j = 1 + ((i+colour+1) & 1); j <= n; j += 2) {
+	  u[ii+j] = 0.25 * (u[ ii+(j-1) ]+
+			    u[ ii+(j+1) ]+
+			    u[ ii-np+j ]+
+			    u[ ii+np+j ]+
+			    f[ii+j]);
+	}
+      }
+    }
+  }
+}
+
+/*
+ * r = f - A u, returns the sum of (r/4)^2, which for f = 0 is the
+ * residual relax_jacobi reports
+ *
+ * Flop count in inner body is 8
+ */
+static double mg_residual( double *u, double *f, double *r, unsigned n )
+{
+  const int np = n+2;
+  double sum=0.0;
+  int i;
+
+#pragma omp parallel for schedule(static) reduction(+:sum)
+  for (i = 1; i <= n; i++) {
+    int ii=i*np;
+    int j;
+#pragma ivdep
+    for (j = 1; j <= n; j++) {
+      double res = f[ii+j] - 4.0*u[ii+j] + (u[ ii+(j-1) ]+
+					    u[ ii+(j+1) ]+
+					    u[ ii-np+j ]+
+					    u[ ii+np+j ]);
+      r[ii+j] = res;
+      sum += 0.0625 * res * res;
+    }
+  }
+  return(sum);
+}
+
+/*
+ * full weighting of the fine residual r into the coarse right hand
+ * side fc, scaled by 4 for the coarser mesh width
+ */
+static void mg_restrict( double *r, unsigned n, double *fc, unsigned nc )
+{
+  const int np = n+2, npc = nc+2;
+  int I;
+
+#pragma omp parallel for schedule(static)
+  for (I = 1; I <= nc; I++) {
+    int ii=2*I*np;
+    int J;
+    for (J = 1; J <= nc; J++) {
+      int j = 2*J;
+      fc[I*npc+J] = 0.25 * (4.0*r[ii+j] +
+			    2.0*(r[ii+j-1] + r[ii+j+1] +
+				 r[ii-np+j] + r[ii+np+j]) +
+			    r[ii-np+j-1] + r[ii-np+j+1] +
+			    r[ii+np+j-1] + r[ii+np+j+1]);
+    }
+  }
+}
+
+/*
+ * add the bilinear interpolation of the coarse error ec to u
+ */
+static void mg_prolong( double *ec, unsigned nc, double *u, unsigned n )
+{
+  const int np = n+2, npc = nc+2;
+  int i;
+
+#pragma omp parallel for schedule(static)
+  for (i = 1; i <= n; i++) {
+    const double *c0 = ec + (i/2)*npc;
+    const double *c1 = ec + ((i+1)/2)*npc;
+    int ii=i*np;
+    int j;
+    for (j = 1; j <= n; j++) {
+      u[ii+j] += 0.25 * (c0[j/2] + c0[(j+1)/2] +
+			 c1[j/2] + c1[(j+1)/2]);
+    }
+  }
+}
+
+static void mg_cycle_level( mg_t *mg, int l, int fcycle )
+{
+  const unsigned n = mg->n[l];
+
+  if (l == mg->nlev-1) {
+    mg_smooth(mg->u[l], mg->f[l], n, MG_COARSE_SWEEPS);
+    return;
+  }
+
+  mg_smooth(mg->u[l], mg->f[l], n, MG_PRE_SWEEPS);
+  mg_residual(mg->u[l], mg->f[l], mg->r[l], n);
+  mg_restrict(mg->r[l], n, mg->f[l+1], mg->n[l+1]);
+  memset(mg->u[l+1], 0, sizeof(double) * (mg->n[l+1]+2) * (mg->n[l+1]+2));
+
+  // an F-cycle does an F-cycle followed by a V-cycle on the coarser level
+  mg_cycle_level(mg, l+1, fcycle);
+  if (fcycle)
+    mg_cycle_level(mg, l+1, 0);
+
+  mg_prolong(mg->u[l+1], mg->n[l+1], mg->u[l], n);
+  mg_smooth(mg->u[l], mg->f[l], n, MG_POST_SWEEPS);
+}
+
+/*
+ * Set up the level hierarchy, u is the finest level (np = res+2)
+ */
+int mg_init( mg_t *mg, double *u, unsigned res )
+{
+  int l;
+
+  mg->nlev = 0;
+  mg->n[0] = res;
+  while (mg->nlev < MG_MAX_LEVELS-1 && mg->n[mg->nlev] > MG_COARSE_SIZE) {
+    mg->n[mg->nlev+1] = (mg->n[mg->nlev]-1) / 2;
+    mg->nlev++;
+  }
+  mg->nlev++;
+
+  for (l = 0; l < mg->nlev; l++) {
+    const int np = mg->n[l]+2;
+    mg->u[l] = l ? (double*)calloc( sizeof(double), np*np ) : u;
+    mg->f[l] = (double*)calloc( sizeof(double), np*np );
+    mg->r[l] = (double*)calloc( sizeof(double), np*np );
+    if ( !(mg->u[l]) || !(mg->f[l]) || !(mg->r[l]) ) {
+      fprintf(stderr, "Error: Cannot allocate memory\n");
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void mg_free( mg_t *mg )
+{
+  int l;
+
+  for (l = 0; l < mg->nlev; l++) {
+    if (l)
+      free(mg->u[l]);
+    free(mg->f[l]);
+    free(mg->r[l]);
+  }
+  mg->nlev = 0;
+}
+
+/*
+ * One V-cycle (fcycle=0) or F-cycle (fcycle=1),
+ * returns the residual of the finest level afterwards
+ */
+double relax_mg( mg_t *mg, int fcycle )
+{
+  mg_cycle_level(mg, 0, fcycle);
+  return(mg_residual(mg->u[0], mg->f[0], mg->r[0], mg->n[0]));
+}
@@ -0,0 +1,149 @@
+/*
+ * relax_sor.c
+ *
+ * Red-black SOR Relaxation
+ *
+ * Point (i,j) is red if i+j+par is even, black otherwise (par lets
+ * a subdomain keep the colouring of the global grid). Red and black
+ * points are kept in separate arrays of width (sizex+1)/2, so a
+ * colour sweep is unit stride: in a row with red offset p (red
+ * points at j = 2k+p), red k has its black left/right neighbours at
+ * k-1+p and k+p and its black upper/lower neighbours at k; black k
+ * has its red left/right neighbours at k-p and k+1-p.
+ *
+ */
+
+#include <math.h>
+#include <omp.h>
+#include "heat.h"
+
+/*
+ * Over-relaxation factor for the Laplace problem on a square
+ * with res inner points per dimension: 2/(1+sin(pi*h))
+ */
+double sor_omega( unsigned res )
+{
+  return(2.0 / (1.0 + sin(M_PI / (double)(res+1))));
+}
+
+/*
+ * copy u into the red and black arrays
+ */
+void sor_split( double *u, double *red, double *black,
+		unsigned sizex, unsigned sizey, int par )
+{
+  const int w = (sizex+1)/2;
+  int i;
+
+#pragma omp parallel for
+  for (i = 0; i < sizey; i++) {
+    const int p = (i+par) & 1;
+    int j;
+    for (j = 0; j < sizex; j++) {
+      if (((j ^ p) & 1) == 0)
+	red[i*w + j/2] = u[i*sizex + j];
+      else
+	black[i*w + j/2] = u[i*sizex + j];
+    }
+  }
+}
+
+/*
+ * copy the red and black arrays back into u
+ */
+void sor_merge( double *u, double *red, double *black,
+		unsigned sizex, unsigned sizey, int par )
+{
+  const int w = (sizex+1)/2;
+  int i;
+
+#pragma omp parallel for
+  for (i = 0; i < sizey; i++) {
+    const int p = (i+par) & 1;
+    int j;
+    for (j = 0; j < sizex; j++) {
+      if (((j ^ p) & 1) == 0)
+	u[i*sizex + j] = red[i*w + j/2];
+      else
+	u[i*sizex + j] = black[i*w + j/2];
+    }
+  }
+}
+
+/*
+ * One sweep over the inner points of one colour (0=red, 1=black),
+ * must be called from within a parallel region.
+ *
+ * Returns the sum of the squared Gauss-Seidel corrections.
+ * Flop count in inner body is 9
+ */
+static double sor_sweep( double *red, double *black,
+			 unsigned sizex, unsigned sizey, int par,
+			 int colour, double omega )
+{
+  const int w = (sizex+1)/2;
+  double *self  = colour ? black : red;
+  double *other = colour ? red : black;
+  double sum=0.0;
+  int i;
+
+#pragma omp for schedule(static)
+  for (i = 1; i < sizey-1; i++) {
+    const int p = (i+par) & 1;
+    // offset of this colour in row i, j = 2k+off
+    const int off = colour ? 1-p : p;
+    // other colour to the left/right of k is at k+lft, k+lft+1
+    const int lft = off-1;
+    const int klo = off ? 0 : 1;
+    const int khi = (sizex-2-off)/2;
+    double *s  = self  + i*w;
+    double *o  = other + i*w;
+    double *on = other + (i-1)*w;
+    double *os = other + (i+1)*w;
+    int k;
+#pragma ivdep
+    for (k = klo; k <= khi; k++) {
+      double gs = 0.25 * (o[ k+lft ]+
+			  o[ k+lft+1 ]+
+			  on[ k ]+
+			  os[ k ]);
+      double diff = gs - s[k];
+      s[k] += omega * diff;
+      sum += diff * diff;
+    }
+  }
+  return(sum);
+}
+
+/*
+ * One sweep over a single colour, own parallel region
+ * (a halo exchange goes between the two colours).
+ */
+double relax_sor_colour( double *red, double *black,
+			 unsigned sizex, unsigned sizey, int par,
+			 int colour, double omega )
+{
+  double sum=0.0;
+
+#pragma omp parallel reduction(+:sum)
+  sum += sor_sweep(red, black, sizex, sizey, par, colour, omega);
+
+  return(sum);
+}
+
+/*
+ * One red-black SOR iteration: red sweep, then black sweep
+ */
+double relax_sor( double *red, double *black,
+		  unsigned sizex, unsigned sizey, int par, double omega )
+{
+  double sum=0.0;
+
+#pragma omp parallel reduction(+:sum)
+  {
+    sum += sor_sweep(red, black, sizex, sizey, par, 0, omega);
+    sum += sor_sweep(red, black, sizex, sizey, par, 1, omega);
+  }
+
+  return(sum);
+}
@@ -0,0 +1,168 @@
+/*
+ * roofline.c
+ *
+ * Machine limits for the roofline model
+ *
+ * The memory bandwidth comes from a STREAM triad over arrays much
+ * larger than the caches, the peak from independent chains of
+ * multiply-adds that stay in registers. Both run on all OpenMP
+ * threads and take the best of a few repetitions. Results are
+ * appended to a calibration file, one line per thread count:
+ *
+ *   <threads> <GB/s> <GFLOP/s>
+ *
+ * Later runs take the last matching line from there.
+ *
+ */
+
+#include <stdlib.h>
+#include <omp.h>
+#include "heat.h"
+#include "timing.h"
+
+#define ROOF_BUFSIZE 200
+
+// keeps the result of the peak probe alive
+double roofline_sink;
+
+/*
+ * GB/s of a[i] = b[i] + s*c[i], counting 3 words per element like
+ * STREAM; 0 if out of memory
+ */
+static double roofline_stream( void )
+{
+  const long n = ROOF_STREAM_SIZE;
+  double *a, *b, *c, t, best = 0;
+  long i;
+  int r;
+
+  a = (double*)malloc( sizeof(double) * n );
+  b = (double*)malloc( sizeof(double) * n );
+  c = (double*)malloc( sizeof(double) * n );
+  if (!a || !b || !c) {
+    free(a);
+    free(b);
+    free(c);
+    return 0;
+  }
+
+#pragma omp parallel for schedule(static)
+  for (i = 0; i < n; i++) {
+    a[i] = 0.0;
+    b[i] = 1.0;
+    c[i] = 2.0;
+  }
+
+  for (r = 0; r < ROOF_REPEAT; r++) {
+    t = wtime();
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < n; i++)
+      a[i] = b[i] + 3.0 * c[i];
+    t = wtime() - t;
+    if (t > 0 && 3.0 * sizeof(double) * n / t / 1e9 > best)
+      best = 3.0 * sizeof(double) * n / t / 1e9;
+  }
+
+  roofline_sink += a[n/2];
+  free(a);
+  free(b);
+  free(c);
+  return(best);
+}
+
+/*
+ * GFLOP/s of ROOF_FMA_LANES independent multiply-add chains per
+ * thread; x and y keep the values near 1, away from denormals
+ */
+static double roofline_fma( void )
+{
+  double t, sum, best = 0;
+  int r;
+
+  for (r = 0; r < ROOF_REPEAT; r++) {
+    sum = 0.0;
+    t = wtime();
+#pragma omp parallel reduction(+:sum)
+    {
+      const double x = 0.999999, y = 1e-6;
+      double a[ROOF_FMA_LANES];
+      int i, k;
+
+      for (k = 0; k < ROOF_FMA_LANES; k++)
+	a[k] = k;
+      for (i = 0; i < ROOF_FMA_ITER; i++) {
+#pragma omp simd
+	for (k = 0; k < ROOF_FMA_LANES; k++)
+	  a[k] = a[k] * x + y;
+      }
+      for (k = 0; k < ROOF_FMA_LANES; k++)
+	sum += a[k];
+    }
+    t = wtime() - t;
+    roofline_sink += sum;
+    if (t > 0 && 2.0 * ROOF_FMA_LANES * ROOF_FMA_ITER * omp_get_max_threads() / t / 1e9 > best)
+      best = 2.0 * ROOF_FMA_LANES * ROOF_FMA_ITER * omp_get_max_threads() / t / 1e9;
+  }
+  return(best);
+}
+
+/*
+ * Look up threads in the calibration file,
+ * returns 0 if there is no entry
+ */
+int roofline_lookup( const char *rooffile, int threads, roofline_t *roof )
+{
+  FILE *f;
+  char buf[ROOF_BUFSIZE];
+  int fthreads, found = 0;
+  roofline_t r;
+
+  if (!(f = fopen(rooffile, "r")))
+    return 0;
+
+  while (fgets(buf, ROOF_BUFSIZE, f)) {
+    if (sscanf(buf, "%d %lf %lf", &fthreads, &r.bandwidth, &r.peak) != 3)
+      continue;
+    if (fthreads != threads || r.bandwidth <= 0 || r.peak <= 0)
+      continue;
+    *roof = r;
+    found = 1;
+  }
+
+  fclose(f);
+  return found;
+}
+
+/*
+ * Measure bandwidth and peak with the current number of threads and
+ * append them to rooffile
+ */
+void roofline_calibrate( const char *rooffile, roofline_t *roof )
+{
+  const int threads = omp_get_max_threads();
+  FILE *f;
+
+  fprintf(stderr, "Roofline calibration, %d threads\n", threads);
+  roof->bandwidth = roofline_stream();
+  roof->peak = roofline_fma();
+
+  if (roof->bandwidth <= 0)
+    return;
+  if (!(f = fopen(rooffile, "a"))) {
+    fprintf(stderr, "Warning: Cannot append to \"%s\"\n", rooffile);
+    return;
+  }
+  fprintf(f, "%d %.3f %.3f\n", threads, roof->bandwidth, roof->peak);
+  fclose(f);
+}
+
+/*
+ * GFLOP/s the roofline allows at intensity flop per byte,
+ * 0 without a calibration
+ */
+double roofline_attainable( const roofline_t *roof, double intensity )
+{
+  const double memory = intensity * roof->bandwidth;
+
+  return(memory < roof->peak ? memory : roof->peak);
+}
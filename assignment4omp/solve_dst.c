@@ -0,0 +1,162 @@
+/*
+ * solve_dst.c
+ *
+ * Direct solver for the steady state using discrete sine transforms
+ *
+ * The inner points satisfy 4u - (left+right+top+bottom) = b, where b
+ * holds the boundary values next to each point. With zero boundaries
+ * this matrix is diagonalised by the DST-I matrix S (S_jk =
+ * sin(pi jk/(n+1)), S*S = (n+1)/2) along both dimensions, with
+ * eigenvalues 4 - 2cos(pi k/(n+1)) - 2cos(pi l/(n+1)), so
+ * u = (2/(n+1))^2 S ((S b S) / lambda) S.
+ *
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <complex.h>
+#include <omp.h>
+#include "heat.h"
+
+#define TRANSPOSE_BLOCK 64
+
+/*
+ * DST-I of every row of a (rows x n), two rows per complex FFT:
+ * the odd extension of a real row has a purely imaginary transform,
+ * so row r goes into the real and row r+1 into the imaginary part
+ */
+static void dst_rows( double *a, int rows, int n, const fft_plan_t *plan )
+{
+  const int N = 2*(n+1);
+
+#pragma omp parallel
+  {
+    double complex *x = (double complex*)malloc( sizeof(double complex) * N );
+    double complex *work = (double complex*)malloc( sizeof(double complex) *
+						    (fft_work_size(plan) + 1) );
+    int r, j;
+
+#pragma omp for schedule(static)
+    for (r = 0; r < rows; r += 2) {
+      double *a1 = a + r*n;
+      double *a2 = (r+1 < rows) ? a + (r+1)*n : 0;
+
+      x[0] = 0;
+      x[n+1] = 0;
+      for (j = 1; j <= n; j++) {
+	double complex v = a1[j-1] + I * (a2 ? a2[j-1] : 0.0);
+	x[j] = v;
+	x[N-j] = -v;
+      }
+
+      fft_exec(plan, x, work);
+
+      // X_k = -2i DST(a1)_k + 2 DST(a2)_k
+      for (j = 1; j <= n; j++) {
+	a1[j-1] = -0.5 * cimag(x[j]);
+	if (a2)
+	  a2[j-1] = 0.5 * creal(x[j]);
+      }
+    }
+
+    free(x);
+    free(work);
+  }
+}
+
+static void transpose( const double *a, double *b, int n )
+{
+  int bi;
+
+#pragma omp parallel for schedule(static)
+  for (bi = 0; bi < n; bi += TRANSPOSE_BLOCK) {
+    int bj, i, j;
+    for (bj = 0; bj < n; bj += TRANSPOSE_BLOCK) {
+      const int ie = bi + TRANSPOSE_BLOCK < n ? bi + TRANSPOSE_BLOCK : n;
+      const int je = bj + TRANSPOSE_BLOCK < n ? bj + TRANSPOSE_BLOCK : n;
+      for (i = bi; i < ie; i++)
+	for (j = bj; j < je; j++)
+	  b[j*n + i] = a[i*n + j];
+    }
+  }
+}
+
+/*
+ * Solve for the inner points of u (sizex = sizey = np) with the
+ * boundary of u as Dirichlet condition. Returns the residual of the
+ * result (same measure as relax_jacobi), -1 if out of memory.
+ */
+double solve_dst( double *u, unsigned sizex, unsigned sizey )
+{
+  const int np = sizex;
+  const int n = np-2;
+  double *a, *b, *lambda;
+  double scale;
+  fft_plan_t plan;
+  int i;
+
+  a = (double*)malloc( sizeof(double) * n*n );
+  b = (double*)malloc( sizeof(double) * n*n );
+  lambda = (double*)malloc( sizeof(double) * n );
+  if (!a || !b || !lambda || !fft_init(&plan, 2*(n+1))) {
+    fprintf(stderr, "Error: Cannot allocate memory\n");
+    // the plan was set up (maybe in part) only if the arrays were there
+    if (a && b && lambda)
+      fft_free(&plan);
+    free(a);
+    free(b);
+    free(lambda);
+    return -1;
+  }
+
+  for (i = 0; i < n; i++)
+    lambda[i] = 2.0 - 2.0 * cos(M_PI * (i+1) / (double)(n+1));
+
+  // boundary values next to the inner points
+#pragma omp parallel for schedule(static)
+  for (i = 0; i < n; i++) {
+    int j;
+    for (j = 0; j < n; j++) {
+      double v = 0.0;
+      if (i == 0)   v += u[j+1];
+      if (i == n-1) v += u[(n+1)*np + j+1];
+      if (j == 0)   v += u[(i+1)*np];
+      if (j == n-1) v += u[(i+1)*np + n+1];
+      a[i*n + j] = v;
+    }
+  }
+
+  // b = (S a S)^T
+  dst_rows(a, n, n, &plan);
+  transpose(a, b, n);
+  dst_rows(b, n, n, &plan);
+
+  // the eigenvalues are symmetric in k and l, so dividing the
+  // transposed coefficients works just as well
+  scale = 4.0 / ((double)(n+1) * (double)(n+1));
+#pragma omp parallel for schedule(static)
+  for (i = 0; i < n; i++) {
+    int j;
+    for (j = 0; j < n; j++)
+      b[i*n + j] *= scale / (lambda[i] + lambda[j]);
+  }
+
+  // a = S b^T S
+  dst_rows(b, n, n, &plan);
+  transpose(b, a, n);
+  dst_rows(a, n, n, &plan);
+
+#pragma omp parallel for schedule(static)
+  for (i = 0; i < n; i++) {
+    int j;
+    for (j = 0; j < n; j++)
+      u[(i+1)*np + j+1] = a[i*n + j];
+  }
+
+  fft_free(&plan);
+  free(a);
+  free(b);
+  free(lambda);
+
+  return(residual_jacobi(u, sizex, sizey, sizex));
+}
@@ -0,0 +1,291 @@
+/*
+ * deep.c
+ *
+ * Jacobi with ghost zones k cells deep
+ *
+ * The grid of the rank is copied into arrays with a k deep halo.
+ * Every k sweeps the halo is exchanged once, columns first and then
+ * full rows including the new ghost columns, so the corners come from
+ * the diagonal neighbours without extra messages. Sweep s of k then
+ * also updates the k-s ghost layers next to every neighbour
+ * (redundantly, the neighbour computes the same values), which leaves
+ * exactly the owned points valid after the k-th sweep. Sides on the
+ * physical boundary never extend; their boundary is the ghost layer
+ * next to the owned points, as with one cell halos.
+ *
+ * The rows of a sweep are shared by the OpenMP threads of the rank,
+ * only the master thread exchanges halos.
+ *
+ * Messages per sweep drop by k, in exchange for larger messages and
+ * about 2(k-1)/2 * (rows+cols) extra points per sweep. deep_model()
+ * measures latency, bandwidth and time per point and picks the k
+ * with the least modelled time per sweep.
+ *
+ */
+
+#include <stdlib.h>
+#include "deep.h"
+
+// repetitions of the measurements in deep_model
+#define DEEP_PROBES 20
+
+static struct
+{
+  int k;
+  int rows, cols;
+  int width;                // cols + 2k
+  int ext[4];               // north, south, west, east: 1 if extending
+  double *u, *utmp;
+  double *base[2];
+  MPI_Datatype column;
+  MPI_Request req[2][2][4]; // buffer, phase (columns, rows), request
+}
+deep;
+
+static void deep_requests( MPI_Comm comm, algoparam_t *param, double *u,
+			   MPI_Request r[2][4] )
+{
+  const int k = deep.k, w = deep.width;
+  const int rows = deep.rows, cols = deep.cols;
+
+  // columns of the owned rows and the rows next to them, which on
+  // the physical boundary need the boundary of the neighbour too;
+  // the tag is the direction of travel
+  MPI_Recv_init(&u[(k-1)*w], 1, deep.column, param->west, 0, comm, &r[0][0]);
+  MPI_Recv_init(&u[(k-1)*w+k+cols], 1, deep.column, param->east, 1, comm, &r[0][1]);
+  MPI_Send_init(&u[(k-1)*w+cols], 1, deep.column, param->east, 0, comm, &r[0][2]);
+  MPI_Send_init(&u[(k-1)*w+k], 1, deep.column, param->west, 1, comm, &r[0][3]);
+
+  // full rows, contiguous
+  MPI_Recv_init(&u[0], k*w, MPI_DOUBLE, param->north, 2, comm, &r[1][0]);
+  MPI_Recv_init(&u[(k+rows)*w], k*w, MPI_DOUBLE, param->south, 3, comm, &r[1][1]);
+  MPI_Send_init(&u[rows*w], k*w, MPI_DOUBLE, param->south, 2, comm, &r[1][2]);
+  MPI_Send_init(&u[k*w], k*w, MPI_DOUBLE, param->north, 3, comm, &r[1][3]);
+}
+
+/*
+ * k clipped to the rows and columns of the smallest rank, no rank may
+ * send more than it owns
+ */
+int deep_limit( algoparam_t *param, MPI_Comm comm, int k )
+{
+  int lim[2] = { param->rows, param->cols };
+
+  MPI_Allreduce(MPI_IN_PLACE, lim, 2, MPI_INT, MPI_MIN, comm);
+  if (k > lim[0]) k = lim[0];
+  if (k > lim[1]) k = lim[1];
+  return(k < 1 ? 1 : k);
+}
+
+static void deep_exchange( MPI_Request r[2][4] )
+{
+  MPI_Startall(4, r[0]);
+  MPI_Waitall(4, r[0], MPI_STATUSES_IGNORE);
+  MPI_Startall(4, r[1]);
+  MPI_Waitall(4, r[1], MPI_STATUSES_IGNORE);
+}
+
+/*
+ * Copy param->u into grids with a k deep halo and set up the
+ * exchange, k must not exceed the rows and columns of any rank
+ */
+int deep_init( algoparam_t *param, MPI_Comm comm, int k )
+{
+  const int ncols = param->cols+2;
+  int height, i, j;
+
+  deep.k = k;
+  deep.rows = param->rows;
+  deep.cols = param->cols;
+  deep.width = param->cols + 2*k;
+  height = param->rows + 2*k;
+  deep.ext[0] = param->north != MPI_PROC_NULL;
+  deep.ext[1] = param->south != MPI_PROC_NULL;
+  deep.ext[2] = param->west != MPI_PROC_NULL;
+  deep.ext[3] = param->east != MPI_PROC_NULL;
+
+  deep.u = (double*)calloc( sizeof(double), height*deep.width );
+  deep.utmp = (double*)calloc( sizeof(double), height*deep.width );
+  if (!deep.u || !deep.utmp) {
+    fprintf(stderr, "Error: Cannot allocate memory\n");
+    free(deep.u);
+    free(deep.utmp);
+    return 0;
+  }
+
+  // the one cell halo of u lands on the innermost ghost layer
+  for (i = 0; i < param->rows+2; i++)
+    for (j = 0; j < ncols; j++)
+      deep.u[(i+k-1)*deep.width + j+k-1] =
+	deep.utmp[(i+k-1)*deep.width + j+k-1] = param->u[i*ncols + j];
+
+  MPI_Type_vector(deep.rows+2, k, deep.width, MPI_DOUBLE, &deep.column);
+  MPI_Type_commit(&deep.column);
+  deep.base[0] = deep.u;
+  deep.base[1] = deep.utmp;
+  deep_requests(comm, param, deep.base[0], deep.req[0]);
+  deep_requests(comm, param, deep.base[1], deep.req[1]);
+
+  // the physical boundary next to the ghost zones of the neighbours
+  // never changes, but is needed in both grids
+  deep_exchange(deep.req[0]);
+  deep_exchange(deep.req[1]);
+  return 1;
+}
+
+/*
+ * Exchange the halo, then nsteps (<= k) Jacobi sweeps on shrinking
+ * regions; returns the residual of the owned points in the last one
+ * if residual is set, else 0
+ *
+ * Flop count in inner body is 7 (4 on sweeps without residual)
+ */
+double deep_sweeps( int nsteps, int residual )
+{
+  const int k = deep.k, w = deep.width;
+  double *help, sum=0.0;
+  int s;
+
+  deep_exchange(deep.req[deep.u == deep.base[0] ? 0 : 1]);
+
+  for (s = 1; s <= nsteps; s++) {
+    const int e = nsteps - s;
+    const int ilo = k - deep.ext[0]*e, ihi = k + deep.rows + deep.ext[1]*e;
+    const int jlo = k - deep.ext[2]*e, jhi = k + deep.cols + deep.ext[3]*e;
+    const int last = residual && s == nsteps;
+    double *u = deep.u, *utmp = deep.utmp;
+    int i;
+
+#pragma omp parallel for reduction(+:sum)
+    for (i = ilo; i < ihi; i++) {
+      int ii=i*w;
+      int j;
+      if (last) {
+	for (j = jlo; j < jhi; j++) {
+	  double unew = 0.25 * (u[ ii+(j-1) ]+
+				u[ ii+(j+1) ]+
+				u[ ii-w+j ]+
+				u[ ii+w+j ]);
+	  double diff = unew - u[ii + j];
+	  utmp[ii+j] = unew;
+	  sum += diff * diff;
+	}
+      } else {
+#pragma ivdep
+	for (j = jlo; j < jhi; j++)
+	  utmp[ii+j] = 0.25 * (u[ ii+(j-1) ]+
+			       u[ ii+(j+1) ]+
+			       u[ ii-w+j ]+
+			       u[ ii+w+j ]);
+      }
+    }
+
+    help = deep.u;
+    deep.u = deep.utmp;
+    deep.utmp = help;
+  }
+  return(sum);
+}
+
+/*
+ * Release the deep grids, with copyback the owned points go back to
+ * param->u
+ */
+void deep_free( algoparam_t *param, int copyback )
+{
+  const int k = deep.k, ncols = param->cols+2;
+  int i, j, b, p;
+
+  if (copyback)
+    for (i = 1; i <= deep.rows; i++)
+      for (j = 1; j <= deep.cols; j++)
+	param->u[i*ncols + j] = deep.u[(i+k-1)*deep.width + j+k-1];
+
+  for (b = 0; b < 2; b++)
+    for (p = 0; p < 2; p++)
+      for (i = 0; i < 4; i++)
+	MPI_Request_free(&deep.req[b][p][i]);
+  MPI_Type_free(&deep.column);
+  free(deep.base[0]);
+  free(deep.base[1]);
+  deep.u = deep.utmp = 0;
+}
+
+/*
+ * seconds per halo exchange and per sweep (nsteps = 1, so only the
+ * owned points) with halo depth k, slowest rank
+ */
+static void deep_probe( algoparam_t *param, MPI_Comm comm, int k,
+			double *texch, double *tsweep )
+{
+  double t[2];
+  int n;
+
+  deep_init(param, comm, k);
+
+  MPI_Barrier(comm);
+  t[0] = MPI_Wtime();
+  for (n = 0; n < DEEP_PROBES; n++)
+    deep_exchange(deep.req[0]);
+  t[0] = (MPI_Wtime() - t[0]) / DEEP_PROBES;
+
+  // deep_sweeps starts with an exchange, which is taken off again
+  t[1] = MPI_Wtime();
+  for (n = 0; n < DEEP_PROBES; n++)
+    deep_sweeps(1, 0);
+  t[1] = (MPI_Wtime() - t[1]) / DEEP_PROBES - t[0];
+
+  deep_free(param, 0);
+  MPI_Allreduce(MPI_IN_PLACE, t, 2, MPI_DOUBLE, MPI_MAX, comm);
+  *texch = t[0];
+  *tsweep = t[1] > 0 ? t[1] : 0;
+}
+
+/*
+ * Pick the halo depth (1..kmax) for the current resolution:
+ *
+ *   T(k) = (alpha + beta * bytes(k) + tpoint * points(k)) / k
+ *
+ * per sweep, with alpha the latency of an exchange, beta the time per
+ * byte, both fitted from exchanges at depth 1 and kmax, and points(k)
+ * the points k sweeps update including the redundant ones. The same
+ * on all ranks, as the inputs are maxima over all ranks.
+ */
+int deep_model( algoparam_t *param, MPI_Comm comm, int kmax )
+{
+  const int rows = param->rows, cols = param->cols;
+  double t1, tk, tsweep, alpha, beta, tpoint, best = 0;
+  double bytes1, bytesk;
+  int k, s, kbest = 1;
+
+  kmax = deep_limit(param, comm, kmax);
+  if (kmax <= 1)
+    return 1;
+
+  deep_probe(param, comm, 1, &t1, &tsweep);
+  deep_probe(param, comm, kmax, &tk, &tsweep);
+
+  bytes1 = 8.0 * (2*rows + 2*(cols+2));
+  bytesk = 8.0 * kmax * (2*rows + 2*(cols+2*kmax));
+  beta = (tk - t1) / (bytesk - bytes1);
+  if (beta < 0) beta = 0;
+  alpha = t1 - beta * bytes1;
+  if (alpha < 0) alpha = 0;
+  tpoint = tsweep / ((double)rows * cols);
+
+  for (k = 1; k <= kmax; k++) {
+    double points = 0, t;
+    for (s = 1; s <= k; s++)
+      points += (double)(rows + 2*(k-s)) * (cols + 2*(k-s));
+    t = (alpha + beta * 8.0 * k * (2*rows + 2*(cols+2*k)) + tpoint * points) / k;
+    if (k == 1 || t < best) {
+      best = t;
+      kbest = k;
+    }
+  }
+
+  if (param->rank == 0)
+    fprintf(stderr, "Deep halo model   : latency %.2f us, %.2f GB/s, %.2f ns/point => k = %d\n",
+	    alpha * 1e6, beta > 0 ? 1e-9 / beta : 0.0, tpoint * 1e9, kbest);
+  return kbest;
+}
@@ -0,0 +1,19 @@
+//
+// deep.h
+//
+
+#ifndef DEEP_H_INCLUDED
+#define DEEP_H_INCLUDED
+
+#include <mpi.h>
+
+#include "heat.h"
+
+int deep_limit( algoparam_t *param, MPI_Comm comm, int k );
+int deep_init( algoparam_t *param, MPI_Comm comm, int k );
+double deep_sweeps( int nsteps, int residual );
+void deep_free( algoparam_t *param, int copyback );
+int deep_model( algoparam_t *param, MPI_Comm comm, int kmax );
+
+
+#endif // DEEP_H_INCLUDED
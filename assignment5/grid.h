@@ -0,0 +1,13 @@
+//
+// grid.h
+//
+
+#ifndef GRID_H_INCLUDED
+#define GRID_H_INCLUDED
+
+#include <mpi.h>
+
+void grid_plan( int nprocs, unsigned res, int dims[2] );
+
+
+#endif // GRID_H_INCLUDED
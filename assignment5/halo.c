@@ -0,0 +1,86 @@
+/*
+ * halo.c
+ *
+ * Zero-copy halo exchange for Jacobi
+ *
+ * The ghost and boundary columns are described by an MPI_Type_vector
+ * over the grid, rows are contiguous, so MPI reads and writes u in
+ * place and nothing is packed into sbuf/rbuf. The sends and receives
+ * are persistent requests, set up once per resolution for each of u
+ * and uhelp (relax_jacobi swaps the two), and only started and
+ * completed in every iteration. Missing neighbours are MPI_PROC_NULL,
+ * their ghost cells keep the fixed boundary.
+ *
+ */
+
+#include "halo.h"
+
+// west, east, north, south
+#define HALO_DIRS 4
+
+static MPI_Datatype column = MPI_DATATYPE_NULL;
+static MPI_Request req[2][2*HALO_DIRS];
+static double *base[2];
+static int nreq = 0;
+
+static void halo_requests( algoparam_t *param, MPI_Comm comm,
+			   double *u, MPI_Request *r )
+{
+  const int ncols = param->cols+2;
+  const int last = (param->rows+1)*ncols;
+
+  // the tag is the direction the data travels in
+  MPI_Recv_init(&u[ncols], 1, column, param->west, 0, comm, &r[0]);
+  MPI_Recv_init(&u[ncols+param->cols+1], 1, column, param->east, 1, comm, &r[1]);
+  MPI_Recv_init(&u[1], param->cols, MPI_DOUBLE, param->north, 2, comm, &r[2]);
+  MPI_Recv_init(&u[last+1], param->cols, MPI_DOUBLE, param->south, 3, comm, &r[3]);
+
+  MPI_Send_init(&u[ncols+param->cols], 1, column, param->east, 0, comm, &r[4]);
+  MPI_Send_init(&u[ncols+1], 1, column, param->west, 1, comm, &r[5]);
+  MPI_Send_init(&u[last-ncols+1], param->cols, MPI_DOUBLE, param->south, 2, comm, &r[6]);
+  MPI_Send_init(&u[ncols+1], param->cols, MPI_DOUBLE, param->north, 3, comm, &r[7]);
+}
+
+/*
+ * Set up the datatype and requests for the current rows x cols of
+ * param->u and param->uhelp; call again after a new initialize()
+ */
+int halo_init( algoparam_t *param, MPI_Comm comm )
+{
+  halo_free();
+
+  if (MPI_Type_vector(param->rows, 1, param->cols+2, MPI_DOUBLE, &column)
+      != MPI_SUCCESS || MPI_Type_commit(&column) != MPI_SUCCESS)
+    return 0;
+
+  base[0] = param->u;
+  base[1] = param->uhelp;
+  halo_requests(param, comm, base[0], req[0]);
+  halo_requests(param, comm, base[1], req[1]);
+  nreq = 2*HALO_DIRS;
+  return 1;
+}
+
+/*
+ * Fill the ghost cells of param->u from the neighbours
+ */
+void halo_exchange( algoparam_t *param )
+{
+  MPI_Request *r = req[param->u == base[0] ? 0 : 1];
+
+  MPI_Startall(nreq, r);
+  MPI_Waitall(nreq, r, MPI_STATUSES_IGNORE);
+}
+
+void halo_free( void )
+{
+  int i;
+
+  for (i = 0; i < nreq; i++) {
+    MPI_Request_free(&req[0][i]);
+    MPI_Request_free(&req[1][i]);
+  }
+  nreq = 0;
+  if (column != MPI_DATATYPE_NULL)
+    MPI_Type_free(&column);
+}
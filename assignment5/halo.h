@@ -0,0 +1,17 @@
+//
+// halo.h
+//
+
+#ifndef HALO_H_INCLUDED
+#define HALO_H_INCLUDED
+
+#include <mpi.h>
+
+#include "heat.h"
+
+int halo_init( algoparam_t *param, MPI_Comm comm );
+void halo_exchange( algoparam_t *param );
+void halo_free( void );
+
+
+#endif // HALO_H_INCLUDED
@@ -15,6 +15,19 @@
 
 #include "heat.h"
 
+/*
+ * the n rows (columns) of part p when res inner points are split
+ * into parts, after the first off of them; the remainder goes one
+ * each to the first parts
+ */
+void block_extent( unsigned res, int parts, int p, int *n, int *off )
+{
+    const int rem = res % parts;
+
+    *n = res / parts + (p < rem);
+    *off = (res / parts) * p + (p < rem ? p : rem);
+}
+
 /*
  * Initialize the iterative solver
  * - allocate memory for matrices
@@ -27,16 +40,12 @@ int initialize( algoparam_t *param )
 
     // total number of points (including border)
     const int np = param->act_res + 2;
-	param->rows = param->act_res / param->dims[1];
-	param->cols = param->act_res / param->dims[0];
-	
 	int r = param->coords[1];
 	int c = param->coords[0];
-	int roffset = param->rows * r;
-	int coffset = param->cols * c;
-	if (param->coords[1] == (param->dims[1]-1))  param->rows += param->act_res % param->dims[1];
-	if (param->coords[0] == (param->dims[0]-1))  param->cols += param->act_res % param->dims[0];
-	//if (param->coords[0] > 0) coffset++;
+	block_extent(param->act_res, param->dims[1], r, &param->rows, &param->roffset);
+	block_extent(param->act_res, param->dims[0], c, &param->cols, &param->coffset);
+	int roffset = param->roffset;
+	int coffset = param->coffset;
 
 	int nrows = param->rows + 2;
 	int ncols = param->cols + 2;
@@ -50,6 +59,19 @@ int initialize( algoparam_t *param )
     (param->uvis)  = (double*)calloc( sizeof(double),
 				      (param->visres+2) *
 				      (param->visres+2) );
+    (param->red) = 0;
+    (param->black) = 0;
+    if( param->algorithm == 1 )
+    {
+	// red and black points, (ncols+1)/2 per row each
+	(param->red)   = (double*)malloc( sizeof(double)* nrows*((ncols+1)/2) );
+	(param->black) = (double*)malloc( sizeof(double)* nrows*((ncols+1)/2) );
+	if( !(param->red) || !(param->black) )
+	{
+	    fprintf(stderr, "Error: Cannot allocate memory\n");
+	    return 0;
+	}
+    }
 
     for (i=0;i<nrows;i++){
     	for (j=0;j<ncols;j++){
@@ -166,6 +188,16 @@ int finalize( algoparam_t *param )
 	param->rbuf = 0;
     }
 
+    if( param->red ) {
+	free(param->red);
+	param->red = 0;
+    }
+
+    if( param->black ) {
+	free(param->black);
+	param->black = 0;
+    }
+
     return 1;
 }
 
@@ -222,6 +254,9 @@ void write_image( FILE * f, double *u,
 	}
     }
 
+    // a flat block (a thin one away from the heat) has max == min
+    if( max<=min )
+	max=min+1;
 
     fprintf(f, "P3\n");
     fprintf(f, "%u %u\n", sizex, sizey);
@@ -231,7 +266,7 @@ void write_image( FILE * f, double *u,
     {
 	for( j=0; j<sizex; j++ )
 	{
-	    k=(int)(1024.0*(u[i*sizex+j]-min)/(max-min));
+	    k=(int)(1023.0*(u[i*sizex+j]-min)/(max-min));
 	    fprintf(f, "%d %d %d  ", r[k], g[k], b[k]);
 	}
 	fprintf(f, "\n");
@@ -281,3 +316,60 @@ int coarsen( double *uold, unsigned oldx, unsigned oldy ,
 
   return 1;
 }
+
+/*
+ * first and last row (column) of the old grid that prolongate()
+ * reads for a block of size rows (columns), halo included, at
+ * offset off of the new grid
+ */
+void prolongate_window( unsigned oldnp, unsigned newnp,
+			unsigned size, unsigned off, int *lo, int *hi )
+{
+    const int on = oldnp;
+    const double scale = (double)(on-1)/(double)(newnp-1);
+    const int first = (int)((off + (off == 0))*scale);
+    const int last = (int)((off + size-1 - (off+size == newnp))*scale);
+
+    *lo = first < on-2 ? first : on-2;
+    *hi = (last < on-2 ? last : on-2) + 1;
+}
+
+/*
+ * bilinear interpolation of the field of an oldnp x oldnp grid
+ * (boundary included) into the block unew (sizex x sizey), whose
+ * point (i,j) is point (roff+i, coff+j) of the newnp x newnp grid;
+ * both grids span the same square. uold holds the old grid from row
+ * r0 and column c0 on, ld points per row, at least the window of
+ * prolongate_window(). All points but the boundary of the grid are
+ * set, the halo too. The initial guess of a resolution from the one
+ * before.
+ */
+void prolongate( double *uold, unsigned oldnp,
+		 unsigned ld, unsigned r0, unsigned c0,
+		 double *unew, unsigned newnp,
+		 unsigned sizex, unsigned sizey,
+		 unsigned roff, unsigned coff )
+{
+    const int on = oldnp;
+    const double scale = (double)(on-1)/(double)(newnp-1);
+    int i, j;
+
+    for( i=(roff == 0); i<sizey-(roff+sizey == newnp); i++ )
+    {
+	const double y = (roff+i)*scale;
+	const int i0 = (int)y < on-2 ? (int)y : on-2;
+	const double ty = y - i0;
+
+	for( j=(coff == 0); j<sizex-(coff+sizex == newnp); j++ )
+	{
+	    const double x = (coff+j)*scale;
+	    const int j0 = (int)x < on-2 ? (int)x : on-2;
+	    const double tx = x - j0;
+	    const double *o = uold + (i0-(int)r0)*(int)ld + j0-(int)c0;
+
+	    unew[i*sizex+j] =
+		(1-ty) * ((1-tx)*o[0]  + tx*o[1]) +
+		ty     * ((1-tx)*o[ld] + tx*o[ld+1]);
+	}
+    }
+}
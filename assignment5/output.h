@@ -0,0 +1,18 @@
+//
+// output.h
+//
+
+#ifndef OUTPUT_H_INCLUDED
+#define OUTPUT_H_INCLUDED
+
+#include <mpi.h>
+
+#include "heat.h"
+
+int write_field_raw( const char *filename, algoparam_t *param,
+		     MPI_Comm comm );
+int write_field_pgm( const char *filename, algoparam_t *param,
+		     MPI_Comm comm );
+
+
+#endif // OUTPUT_H_INCLUDED
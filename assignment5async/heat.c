@@ -1,7 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <limits.h>
 #include "input.h"
 #include "heat.h"
+#include "overlap.h"
+#include "output.h"
+#include "grid.h"
 #include "timing.h"
 #include "omp.h"
 #include "mmintrin.h"
@@ -15,8 +21,164 @@ double gettime() {
 	return MPI_Wtime();
 }
 
+/*
+ * Pipelined global residual check: the MPI_Iallreduce of a check is
+ * started after its sweep and completed after the next one, so the
+ * reduction runs behind a sweep instead of stalling the pipeline and
+ * the solver stops at most one sweep (or block of sweeps) late. One
+ * check is in flight at a time.
+ */
+typedef struct {
+	MPI_Request req;
+	double local, global;
+	int iter;		// iteration of the check in flight, -1 if none
+} gcheck_t;
+
+static void gcheck_init(gcheck_t *g) {
+	g->global = 999999999;
+	g->iter = -1;
+}
+
+static void gcheck_start(gcheck_t *g, MPI_Comm comm, int iter, double residual) {
+	g->local = residual;
+	g->iter = iter;
+	MPI_Iallreduce(&g->local, &g->global, 1, MPI_DOUBLE, MPI_SUM, comm, &g->req);
+}
+
+// completes the check in flight, returns 1 once converged
+static int gcheck_finish(gcheck_t *g, converge_t *conv) {
+	int iter = g->iter;
+
+	if (iter < 0)
+		return 0;
+	MPI_Wait(&g->req, MPI_STATUS_IGNORE);
+	g->iter = -1;
+	return converge_update(conv, iter, g->global);
+}
+
+// whether iteration iter needs the residual, *stop if a check it had
+// to wait for converged
+static int gcheck_due(gcheck_t *g, converge_t *conv, int iter, int *stop) {
+	*stop = 0;
+	if (!converge_due(conv, iter))
+		return 0;
+	if (g->iter < 0)
+		return 1;
+	// the last iteration always gets its check, after the one in flight
+	if (iter < conv->maxiter - 1)
+		return 0;
+	*stop = gcheck_finish(g, conv);
+	return !*stop;
+}
+
+/*
+ * Rows box[0]..box[1] and columns box[2]..box[3] of the old grid of
+ * np points that rank q holds in its old block (own) and that the
+ * prolongation into its new block reads (need). The blocks follow
+ * from the process grid as in initialize().
+ */
+static void warm_boxes(algoparam_t *param, MPI_Comm comm, int q, unsigned np, int own[4], int need[4]) {
+	int c[2], d, n, off;
+
+	MPI_Cart_coords(comm, q, 2, c);
+	// rows are split along dims[1], columns along dims[0]
+	for (d = 0; d < 2; d++) {
+		block_extent(np - 2, param->dims[1 - d], c[1 - d], &n, &off);
+		own[2 * d] = off == 0 ? 0 : off + 1;
+		own[2 * d + 1] = off + n + 2 == np ? np - 1 : off + n;
+		block_extent(param->act_res, param->dims[1 - d], c[1 - d], &n, &off);
+		prolongate_window(np, param->act_res + 2, n + 2, off, &need[2 * d], &need[2 * d + 1]);
+	}
+}
+
+// intersection of boxes a and b into box, returns its points
+static int warm_meet(const int a[4], const int b[4], int box[4]) {
+	int d;
+
+	for (d = 0; d < 4; d += 2) {
+		box[d] = a[d] > b[d] ? a[d] : b[d];
+		box[d + 1] = a[d + 1] < b[d + 1] ? a[d + 1] : b[d + 1];
+		if (box[d] > box[d + 1])
+			return 0;
+	}
+	return (box[1] - box[0] + 1) * (box[3] - box[2] + 1);
+}
+
+/*
+ * For the warm start, the part of the field of the resolution before
+ * (np points) that the prolongation into the new block of this rank
+ * reads: rows win[0]..win[1] and columns win[2]..win[3] of the old
+ * grid. Called with the old blocks still in param and act_res already
+ * the new resolution. Each rank sends every other rank just the part
+ * of its old block that rank needs, in one MPI_Alltoallv.
+ */
+static double *gather_window(algoparam_t *param, MPI_Comm comm, unsigned np, int win[4]) {
+	const int sizex = param->cols + 2;
+	int own[4], need[4], mine[4], box[4];
+	int *scount, *sdispl, *rcount, *rdispl;
+	int nprocs, q, i, j, k, width;
+	double *sbuf, *rbuf, *w;
+
+	MPI_Comm_size(comm, &nprocs);
+	warm_boxes(param, comm, param->rank, np, mine, win);
+	width = win[3] - win[2] + 1;
+
+	scount = (int *) malloc(sizeof(int) * 4 * nprocs);
+	if (!scount)
+		return 0;
+	sdispl = scount + nprocs;
+	rcount = sdispl + nprocs;
+	rdispl = rcount + nprocs;
+	for (q = 0; q < nprocs; q++) {
+		warm_boxes(param, comm, q, np, own, need);
+		scount[q] = warm_meet(need, mine, box);
+		rcount[q] = warm_meet(win, own, box);
+		sdispl[q] = q ? sdispl[q - 1] + scount[q - 1] : 0;
+		rdispl[q] = q ? rdispl[q - 1] + rcount[q - 1] : 0;
+	}
+
+	sbuf = (double *) malloc(sizeof(double) * (sdispl[nprocs - 1] + scount[nprocs - 1] + 1));
+	rbuf = (double *) malloc(sizeof(double) * (rdispl[nprocs - 1] + rcount[nprocs - 1] + 1));
+	w = (double *) malloc(sizeof(double) * (win[1] - win[0] + 1) * width);
+	if (!sbuf || !rbuf || !w) {
+		free(scount);
+		free(sbuf);
+		free(rbuf);
+		free(w);
+		return 0;
+	}
+
+	for (q = 0, k = 0; q < nprocs; q++) {
+		warm_boxes(param, comm, q, np, own, need);
+		if (warm_meet(need, mine, box))
+			for (i = box[0]; i <= box[1]; i++)
+				for (j = box[2]; j <= box[3]; j++)
+					sbuf[k++] = param->u[(i - param->roffset) * sizex + j - param->coffset];
+	}
+	MPI_Alltoallv(sbuf, scount, sdispl, MPI_DOUBLE, rbuf, rcount, rdispl, MPI_DOUBLE, comm);
+	for (q = 0, k = 0; q < nprocs; q++) {
+		warm_boxes(param, comm, q, np, own, need);
+		if (warm_meet(win, own, box))
+			for (i = box[0]; i <= box[1]; i++)
+				for (j = box[2]; j <= box[3]; j++)
+					w[(i - win[0]) * width + j - win[2]] = rbuf[k++];
+	}
+
+	free(scount);
+	free(sbuf);
+	free(rbuf);
+	return w;
+}
+
 void usage(char *s) {
-	fprintf(stderr, "Usage: %s <input file> <prows> <pcols> [result file]\n\n", s);
+	fprintf(stderr, "Usage: %s [-o raw] [-g pgm] [-c n] [-C file] [--restart] <input file> [<prows> <pcols>] [result file]\n\n", s);
+	fprintf(stderr, "  without prows and pcols the process grid is planned for the largest resolution\n\n");
+	fprintf(stderr, "  -o file   write the global field as one raw file (header and doubles)\n");
+	fprintf(stderr, "  -g file   write the global field as one binary greyscale PGM\n");
+	fprintf(stderr, "  -c n      snapshot of the state every n iterations\n");
+	fprintf(stderr, "  -C file   snapshot file, one per rank with the coordinates appended (default: %s)\n", CKPT_FILE);
+	fprintf(stderr, "  --restart go on from the newest snapshot all ranks have\n");
+	fprintf(stderr, "  -W        start each resolution from the field of the one before (default: from zero)\n\n");
 }
 
 int main(int argc, char *argv[]) {
@@ -33,7 +195,23 @@ int main(int argc, char *argv[]) {
 
 	// timing
 
-	double residual;
+	double residual, total_res;
+	converge_t conv;
+	gcheck_t check;
+	int due, stop, provided, opt, nprocs;
+	char *rawname = 0, *pgmname = 0;
+	int interval = 0, restart = 0, ok, warm = 0;
+	double *prev;
+	unsigned prevnp = 0;
+	int win[4];
+	unsigned seq;
+	char *ckptname = CKPT_FILE, ckptfile[256];
+	ckpt_t ckpt;
+	ckpt_header_t snap;
+	static struct option longopts[] = {
+		{ "restart", no_argument, 0, 'R' },
+		{ 0, 0, 0, 0 }
+	};
 
 	// MPI params
 	param.periods[0] = 0;
@@ -41,24 +219,54 @@ int main(int argc, char *argv[]) {
 
 	// set the visualization resolution
 	param.visres = 100;
+	ckpt.map = 0;
+
+	// check options
+	while ((opt = getopt_long(argc, argv, "o:g:c:C:W", longopts, 0)) != -1) {
+		switch (opt) {
+		case 'o':
+			rawname = optarg;
+			break;
+		case 'g':
+			pgmname = optarg;
+			break;
+		case 'c':
+			interval = atoi(optarg);
+			break;
+		case 'C':
+			ckptname = optarg;
+			break;
+		case 'R':
+			restart = 1;
+			break;
+		case 'W':
+			warm = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	// drop the options, keep the program name in argv[0]
+	argv[optind - 1] = argv[0];
+	argc -= optind - 1;
+	argv += optind - 1;
 
 	// check arguments
-	if (argc < 4) {
+	if (argc < 2 || argc == 3) {
 		usage(argv[0]);
 		return 1;
 	}
 	// MPI initialization
-	MPI_Init(&argc, &argv);
-	// Cart grid uses x-y, we use row column
-	param.dims[0] = atoi(argv[3]);
-	param.dims[1] = atoi(argv[2]);
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+	MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
 	MPI_Comm_rank(MPI_COMM_WORLD, &param.rank);
-	MPI_Cart_create(MPI_COMM_WORLD, 2,
-                    param.dims, param.periods,
-                    param.reorder, &comm);
-	MPI_Cart_coords(comm, param.rank, 2, param.coords);
-	MPI_Cart_shift(comm, 0, 1, &param.west, &param.east);
-  	MPI_Cart_shift(comm, 1, 1, &param.north, &param.south);
+	// only the master thread calls MPI, see overlap.c
+	if (provided < MPI_THREAD_FUNNELED) {
+		if (param.rank == 0)
+			fprintf(stderr, "Warning: MPI does not support threads, running on one thread\n");
+		omp_set_num_threads(1);
+	}
 
 	// check input file
 	if (!(infile = fopen(argv[1], "r"))) {
@@ -68,6 +276,31 @@ int main(int argc, char *argv[]) {
 		return 1;
 	}
 
+	// check input
+	if (!read_input(infile, &param)) {
+		fprintf(stderr, "\nError: Error parsing input file.\n\n");
+
+		usage(argv[0]);
+		return 1;
+	}
+
+	// Cart grid uses x-y, we use row column
+	if (argc >= 4) {
+		param.dims[0] = atoi(argv[3]);
+		param.dims[1] = atoi(argv[2]);
+	} else {
+		grid_plan(nprocs, param.max_res, param.dims);
+	}
+	// let MPI place neighbours close to each other
+	param.reorder = 1;
+	MPI_Cart_create(MPI_COMM_WORLD, 2,
+                    param.dims, param.periods,
+                    param.reorder, &comm);
+	MPI_Comm_rank(comm, &param.rank);
+	MPI_Cart_coords(comm, param.rank, 2, param.coords);
+	MPI_Cart_shift(comm, 0, 1, &param.west, &param.east);
+  	MPI_Cart_shift(comm, 1, 1, &param.north, &param.south);
+
 	// check result file
 	sprintf(resfilename, "heat%d_%d.ppm", param.coords[0], param.coords[1]);
 
@@ -78,25 +311,49 @@ int main(int argc, char *argv[]) {
 		return 1;
 	}
 
-	// check input
-	if (!read_input(infile, &param)) {
-		fprintf(stderr, "\nError: Error parsing input file.\n\n");
-
-		usage(argv[0]);
-		return 1;
+	if (param.rank==0) {
+		print_params(&param);
+		fprintf(stderr, "Process grid      : %d x %d%s\n", param.dims[1], param.dims[0], argc >= 4 ? "" : " (planned)");
+		if (warm)
+			fprintf(stderr, "Initial guess     : previous resolution, bilinear\n");
 	}
 
-	if (param.rank==0) print_params(&param);
+	// the ranks go on from the newest snapshot all of them have; as
+	// every rank completes a snapshot before any starts the next,
+	// the older slot still holds it where a newer one is complete
+	snprintf(ckptfile, sizeof(ckptfile), "%s.%d_%d", ckptname, param.coords[0], param.coords[1]);
+	if (restart) {
+		seq = ckpt_find(ckptfile, &param, UINT_MAX, &snap) ? snap.seq : 0;
+		MPI_Allreduce(MPI_IN_PLACE, &seq, 1, MPI_UNSIGNED, MPI_MIN, comm);
+		ok = seq > 0 && ckpt_find(ckptfile, &param, seq, &snap) && snap.seq == seq;
+		MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, comm);
+		restart = ok;
+		if (param.rank == 0 && !restart)
+			fprintf(stderr, "Warning: No snapshot of this run in \"%s.*\", starting from the beginning\n", ckptname);
+		if (param.rank == 0 && restart)
+			fprintf(stderr, "Restart           : resolution %u, iteration %d\n", snap.act_res, snap.iter);
+	}
 	time = (double *) calloc(sizeof(double), (int) (param.max_res - param.initial_res + param.res_step_size) / param.res_step_size);
 
 	int exp_number = 0;
 
-	for (param.act_res = param.initial_res; param.act_res <= param.max_res; param.act_res = param.act_res + param.res_step_size) {
+	for (param.act_res = restart ? snap.act_res : param.initial_res; param.act_res <= param.max_res; param.act_res = param.act_res + param.res_step_size) {
+		// the field of the resolution before, for the warm start
+		prev = (warm && prevnp) ? gather_window(&param, comm, prevnp, win) : 0;
+
 		if (!initialize(&param)) {
 			fprintf(stderr, "Error in Jacobi initialization.\n\n");
 
 			usage(argv[0]);
 		}
+		if (prev) {
+			prolongate(prev, prevnp, win[3] - win[2] + 1, win[0], win[2], param.u, param.act_res + 2, param.cols + 2, param.rows + 2, param.roffset, param.coffset);
+			free(prev);
+		}
+		if (restart && !ckpt_read(ckptfile, &snap, param.u)) {
+			fprintf(stderr, "\nError: Cannot read the snapshot in \"%s\".\n\n", ckptfile);
+			return 1;
+		}
 
 		for (i = 0; i < param.rows + 2; i++) {
 			for (j = 0; j < param.cols + 2; j++) {
@@ -112,40 +369,53 @@ int main(int argc, char *argv[]) {
 			time[exp_number] = wtime();
 			t0 = gettime();
 		}
-		// Initialize rbuf for non-communicating procs
-		for(i = 0; i < param.rows; i++) param.rbuf[i] = param.u[(i+1)*(param.cols+2)]; //west
-		for(i = 0; i < param.rows; i++) param.rbuf[param.rows + i] = param.u[(i+1)*(param.cols+2)+param.cols+1]; //east
-		for(i = 0; i < param.cols; i++) param.rbuf[2 * param.rows + i] = param.u[i+1]; //north
-		for(i = 0; i < param.cols; i++) param.rbuf[param.cols + 2 * param.rows + i] = param.u[(param.rows+1)*(param.cols+2)+i+1]; //south*/
-		
-		for (iter = 0; iter < param.maxiter; iter++) {
-			residual = relax_jacobi_outer(&(param.u), &(param.uhelp), param.cols+2, param.rows+2);
-			
-			for(i = 0; i < param.rows; i++) param.sbuf[i] = param.uhelp[(i+1)*(param.cols+2)+1]; //west
-			for(i = 0; i < param.rows; i++) param.sbuf[param.rows + i] = param.uhelp[(i+1)*(param.cols+2)+param.cols]; //east
-			for(i = 0; i < param.cols; i++) param.sbuf[2 * param.rows + i] = param.uhelp[param.cols+2+i+1]; //north
-			for(i = 0; i < param.cols; i++) param.sbuf[2 * param.rows + param.cols + i] = param.uhelp[(param.rows)*(param.cols+2)+i+1]; //south	
-			int counts[4] = {param.rows, param.rows, param.cols, param.cols};
-			int displs[4] = {0, param.rows, 2*param.rows, 2*param.rows + param.cols};
-			
-			MPI_Request request;
-			MPI_Status status;
-			MPI_Ineighbor_alltoallv(param.sbuf, counts, displs,
-                            MPI_DOUBLE, param.rbuf, counts,
-                            displs, MPI_DOUBLE, comm, &request);
-
-			residual += relax_jacobi_inner(&(param.u), &(param.uhelp), param.cols+2, param.rows+2);
-			MPI_Wait(&request, &status);
-			
-			swap(&(param.u), &(param.uhelp));
-			for(i = 0; i < param.rows; i++) param.u[(i+1)*(param.cols+2)] = param.rbuf[i]; //west
-			for(i = 0; i < param.rows; i++) param.u[(i+1)*(param.cols+2)+param.cols+1] = param.rbuf[param.rows + i]; //east
-			for(i = 0; i < param.cols; i++) param.u[i+1] = param.rbuf[2 * param.rows + i]; //north
-			for(i = 0; i < param.cols; i++) param.u[(param.rows+1)*(param.cols+2)+i+1] = param.rbuf[param.cols + 2 * param.rows + i]; //south*/
+		// every rank sees the same global residuals, so all of them
+		// check and stop in the same iterations
+		converge_init(&conv, RESIDUAL_LIMIT, param.maxiter);
+		gcheck_init(&check);
+		iter = 0;
+		due = 0;
+		if (restart) {
+			iter = snap.iter;
+			conv = snap.conv;
+			residual = snap.residual;
+			due = snap.pending;
+			if (due)
+				gcheck_start(&check, comm, iter - 1, residual);
+			restart = 0;
 		}
-
-		double total_res;
-		MPI_Reduce(&residual, &total_res, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
+		if (interval > 0) {
+			ok = ckpt_open(&ckpt, ckptfile, &param, param.cols+2, param.rows+2, interval, iter);
+			MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, comm);
+			if (!ok) {
+				if (param.rank == 0)
+					fprintf(stderr, "Warning: Cannot write snapshots to \"%s.*\"\n", ckptname);
+				ckpt_close(&ckpt);
+			}
+			ckpt_save(&ckpt, iter, &conv, residual, due, param.u);
+		}
+		for (; iter < param.maxiter; ) {
+			due = gcheck_due(&check, &conv, iter, &stop);
+			if (stop)
+				break;
+			residual = relax_jacobi_overlap(&param, comm, due);
+			iter++;
+			if (gcheck_finish(&check, &conv))
+				break;
+			// all ranks save in the same iterations, with the check
+			// of this one still to be started
+			if (ckpt_due(&ckpt, iter)) {
+				ckpt_wait(&ckpt);
+				MPI_Barrier(comm);
+				ckpt_save(&ckpt, iter, &conv, residual, due, param.u);
+			}
+			if (due)
+				gcheck_start(&check, comm, iter - 1, residual);
+		}
+		ckpt_close(&ckpt);
+		// the check of the last iteration is still in flight
+		gcheck_finish(&check, &conv);
+		total_res = check.global;
 
 		if (param.rank == 0) {
 			t1 = gettime();
@@ -156,19 +426,26 @@ int main(int argc, char *argv[]) {
 			printf("Execution time: %f\n", time[exp_number]);
 			printf("Residual: %f\n\n", total_res);
 
-			printf("megaflops:  %.1lf\n", (double) param.maxiter * (np - 2) * (np - 2) * 7 / time[exp_number] / 1000000);
-			printf("  flop instructions (M):  %.3lf\n", (double) param.maxiter * (np - 2) * (np - 2) * 7 / 1000000);
+			printf("Iterations: %d (%d residual checks)\n\n", iter, conv.checks);
+
+			printf("megaflops:  %.1lf\n", (double) iter * (np - 2) * (np - 2) * JACOBI_FLOP / time[exp_number] / 1000000);
+			printf("  flop instructions (M):  %.3lf\n", (double) iter * (np - 2) * (np - 2) * JACOBI_FLOP / 1000000);
+			printf("  effective GB/s:  %.3lf\n", (double) iter * (np - 2) * (np - 2) * JACOBI_WORDS * sizeof(double) / time[exp_number] / 1000000000);
 
 			exp_number++;
 		}
-		
+		prevnp = np;
 	}
 
 	param.act_res = param.act_res - param.res_step_size;
 
-	coarsen(param.u, param.rows + 2, param.cols + 2, param.uvis, param.visres + 2, param.visres + 2);
+	coarsen(param.u, param.cols + 2, param.rows + 2, param.uvis, param.visres + 2, param.visres + 2);
 
 	//write_image(resfile, param.uvis, param.visres + 2, param.visres + 2);
+	if (rawname)
+		write_field_raw(rawname, &param, comm);
+	if (pgmname)
+		write_field_pgm(pgmname, &param, comm);
 	finalize(&param);
 	MPI_Finalize();
 	return 0;
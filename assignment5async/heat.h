@@ -7,6 +7,23 @@
 #ifndef JACOBI_H_INCLUDED
 #define JACOBI_H_INCLUDED
 
+// work model per inner point and iteration, the same in all
+// variants: flop and grid words through memory of one update
+#define JACOBI_FLOP 7
+#define JACOBI_WORDS 2
+
+// residual the sequential solver stops at, 0 runs all iterations
+#ifndef RESIDUAL_LIMIT
+#define RESIDUAL_LIMIT 0.000005
+#endif
+
+// convergence monitor: first and largest interval between checks
+#define CONV_INTERVAL 16
+#define CONV_MAX_INTERVAL 128
+
+// default snapshot file of the checkpoints, one per rank
+#define CKPT_FILE "heat.ckpt"
+
 #include <stdio.h>
 
 // configuration
@@ -42,20 +59,72 @@ typedef struct
     int rank;
     int north, south, east, west;
     int rows, cols;
+    int roffset, coffset;   // global index of the first inner point - 1
     double *sbuf, *rbuf;
 }
 algoparam_t;
 
+// convergence monitor
+typedef struct
+{
+    double tol;             // stop below this residual, <= 0 => never
+    int maxiter;
+    int interval;           // iterations between two checks
+    int next;               // iteration of the next check
+    int lastiter;           // iteration of the last check
+    double last;            // residual of the last check
+    int checks;             // number of checks so far
+}
+converge_t;
+
+// header of a snapshot in the checkpoint file
+typedef struct
+{
+    char magic[8];
+    unsigned seq;           // number of the snapshot, 0 => slot empty
+    unsigned maxiter;
+    unsigned act_res;
+    unsigned sizex, sizey;  // of the block of the rank
+    int dims[2], coords[2]; // process grid and place in it
+    int iter;               // iterations done
+    double residual;        // last local residual
+    int pending;            // its global check is still to be done
+    converge_t conv;
+}
+ckpt_header_t;
+
+// checkpoints in progress
+typedef struct
+{
+    int fd;
+    char *map;              // the file, 0 => no checkpoints
+    size_t size, bytes;     // of the file and of one block
+    double *stage;          // copy of u being written
+    ckpt_header_t next;     // header of the snapshot being written
+    int interval, due;      // iterations between snapshots, next one
+    int busy, stop;
+    struct ckpt_sync *sync; // writer thread and its lock
+}
+ckpt_t;
+
 
 // function declarations
 
 // misc.c
+void block_extent( unsigned res, int parts, int p, int *n, int *off );
 int initialize( algoparam_t *param );
 int finalize( algoparam_t *param );
 void write_image( FILE * f, double *u,
 		  unsigned sizex, unsigned sizey );
 int coarsen(double *uold, unsigned oldx, unsigned oldy ,
 	    double *unew, unsigned newx, unsigned newy );
+void prolongate_window( unsigned oldnp, unsigned newnp,
+			unsigned size, unsigned off, int *lo, int *hi );
+void prolongate( double *uold, unsigned oldnp,
+		 unsigned ld, unsigned r0, unsigned c0,
+		 double *unew, unsigned newnp,
+		 unsigned sizex, unsigned sizey,
+		 unsigned roff, unsigned coff );
 
 // Gauss-Seidel: relax_gauss.c
 double residual_gauss( double *u, double *utmp,
@@ -71,8 +140,25 @@ double relax_jacobi( double **u, double **utmp,
 double relax_jacobi_outer( double **u, double **utmp, 
      unsigned sizex, unsigned sizey);
 double relax_jacobi_inner( double **u, double **utmp, 
-     unsigned sizex, unsigned sizey);
+     unsigned sizex, unsigned sizey, int residual);
 void swap( double **u1, double **utmp1 );
 
+// convergence monitor: converge.c
+void converge_init( converge_t *c, double tol, int maxiter );
+int converge_due( const converge_t *c, int iter );
+int converge_update( converge_t *c, int iter, double residual );
+
+// checkpoint/restart: checkpoint.c
+int ckpt_open( ckpt_t *c, const char *name, const algoparam_t *param,
+	       unsigned sizex, unsigned sizey, int interval, int iter );
+int ckpt_due( const ckpt_t *c, int iter );
+void ckpt_wait( ckpt_t *c );
+void ckpt_save( ckpt_t *c, int iter, const converge_t *conv,
+		double residual, int pending, const double *u );
+void ckpt_close( ckpt_t *c );
+int ckpt_find( const char *name, const algoparam_t *param,
+	       unsigned maxseq, ckpt_header_t *h );
+int ckpt_read( const char *name, const ckpt_header_t *h, double *u );
+
 
 #endif // JACOBI_H_INCLUDED
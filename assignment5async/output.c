@@ -0,0 +1,161 @@
+/*
+ * output.c
+ *
+ * Collective output of the global temperature field with MPI-IO
+ *
+ * Every rank owns its inner points plus the boundary on the sides of
+ * the domain it touches. A subarray file view puts that block at its
+ * place in the global (res+2) x (res+2) grid, a subarray memory type
+ * picks it out of u without copying, and one MPI_File_write_at_all
+ * writes the whole field in a single parallel pass.
+ *
+ * Raw format: a text header of FIELD_HEADER bytes,
+ *
+ *   HEAT <sizex> <sizey> double\n
+ *
+ * padded with spaces, followed by sizey rows of sizex doubles in the
+ * native byte order.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include "output.h"
+
+#define FIELD_HEADER 64
+
+typedef struct
+{
+  int gsize[2];             // global rows, columns
+  int lsize[2];             // local grid with halo
+  int size[2];              // the block this rank writes
+  int gstart[2];            // where it is in the global grid
+  int lstart[2];            // and in the local one
+}
+block_t;
+
+static void field_block( algoparam_t *param, block_t *b )
+{
+  const int top = param->coords[1] == 0;
+  const int bottom = param->coords[1] == param->dims[1]-1;
+  const int left = param->coords[0] == 0;
+  const int right = param->coords[0] == param->dims[0]-1;
+
+  b->gsize[0] = b->gsize[1] = param->act_res + 2;
+  b->lsize[0] = param->rows + 2;
+  b->lsize[1] = param->cols + 2;
+  b->size[0] = param->rows + top + bottom;
+  b->size[1] = param->cols + left + right;
+  b->gstart[0] = param->roffset + !top;
+  b->gstart[1] = param->coffset + !left;
+  b->lstart[0] = !top;
+  b->lstart[1] = !left;
+}
+
+/*
+ * rank 0 writes the header, then every rank count elements of
+ * memtype from buf into its block behind it; returns 0 on error
+ */
+static int field_write( const char *filename, MPI_Comm comm,
+			const char *header, int hlen, block_t *b,
+			void *buf, int count, MPI_Datatype memtype,
+			MPI_Datatype etype )
+{
+  MPI_File fh;
+  MPI_Datatype filetype;
+  int rank, ok;
+
+  MPI_Comm_rank(comm, &rank);
+  if (MPI_File_open(comm, (char*)filename, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+		    MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+    if (rank == 0)
+      fprintf(stderr, "Error: Cannot open \"%s\" for writing.\n", filename);
+    return 0;
+  }
+  MPI_File_set_size(fh, 0);
+
+  MPI_File_write_at_all(fh, 0, (void*)header, rank == 0 ? hlen : 0,
+			MPI_CHAR, MPI_STATUS_IGNORE);
+
+  MPI_Type_create_subarray(2, b->gsize, b->size, b->gstart, MPI_ORDER_C,
+			   etype, &filetype);
+  MPI_Type_commit(&filetype);
+  MPI_File_set_view(fh, hlen, etype, filetype, "native", MPI_INFO_NULL);
+  ok = MPI_File_write_at_all(fh, 0, buf, count, memtype, MPI_STATUS_IGNORE)
+    == MPI_SUCCESS;
+
+  MPI_Type_free(&filetype);
+  MPI_File_close(&fh);
+  return ok;
+}
+
+/*
+ * param->u of all ranks as one raw file
+ */
+int write_field_raw( const char *filename, algoparam_t *param,
+		     MPI_Comm comm )
+{
+  char header[FIELD_HEADER+1];
+  MPI_Datatype memtype;
+  block_t b;
+  int ok;
+
+  field_block(param, &b);
+
+  snprintf(header, sizeof(header), "HEAT %d %d double", b.gsize[1], b.gsize[0]);
+  memset(header + strlen(header), ' ', FIELD_HEADER - strlen(header));
+  header[FIELD_HEADER-1] = '\n';
+
+  MPI_Type_create_subarray(2, b.lsize, b.size, b.lstart, MPI_ORDER_C,
+			   MPI_DOUBLE, &memtype);
+  MPI_Type_commit(&memtype);
+  ok = field_write(filename, comm, header, FIELD_HEADER, &b, param->u,
+		   1, memtype, MPI_DOUBLE);
+  MPI_Type_free(&memtype);
+  return ok;
+}
+
+/*
+ * param->u of all ranks as one binary (P5) greyscale PGM, scaled to
+ * the global minimum and maximum
+ */
+int write_field_pgm( const char *filename, algoparam_t *param,
+		     MPI_Comm comm )
+{
+  char header[FIELD_HEADER];
+  double range[2] = { DBL_MAX, -DBL_MAX }; // min, -max
+  unsigned char *grey;
+  block_t b;
+  int i, j, hlen, ok;
+
+  field_block(param, &b);
+
+  for (i = 0; i < b.size[0]; i++)
+    for (j = 0; j < b.size[1]; j++) {
+      double v = param->u[(b.lstart[0]+i)*b.lsize[1] + b.lstart[1]+j];
+      if (v < range[0]) range[0] = v;
+      if (-v < range[1]) range[1] = -v;
+    }
+  MPI_Allreduce(MPI_IN_PLACE, range, 2, MPI_DOUBLE, MPI_MIN, comm);
+  range[1] = -range[1] - range[0];
+  if (range[1] <= 0)
+    range[1] = 1;
+
+  grey = (unsigned char*)malloc( (size_t)b.size[0] * b.size[1] );
+  if (!grey) {
+    fprintf(stderr, "Error: Cannot allocate memory\n");
+    MPI_Abort(comm, 1);
+  }
+  for (i = 0; i < b.size[0]; i++)
+    for (j = 0; j < b.size[1]; j++) {
+      double v = param->u[(b.lstart[0]+i)*b.lsize[1] + b.lstart[1]+j];
+      grey[i*b.size[1]+j] = (unsigned char)(255.0 * (v - range[0]) / range[1] + 0.5);
+    }
+
+  hlen = snprintf(header, sizeof(header), "P5\n%d %d\n255\n", b.gsize[1], b.gsize[0]);
+  ok = field_write(filename, comm, header, hlen, &b, grey,
+		   b.size[0] * b.size[1], MPI_UNSIGNED_CHAR, MPI_UNSIGNED_CHAR);
+  free(grey);
+  return ok;
+}
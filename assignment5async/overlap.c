@@ -0,0 +1,149 @@
+/*
+ * overlap.c
+ *
+ * Jacobi sweep with the halo exchange overlapped by the interior
+ *
+ * All threads first compute the four boundary strips (the points the
+ * neighbours need). Then the master thread is the communication
+ * thread: it sends the strips and unpacks each neighbour's halo as
+ * soon as that message arrives, while the other threads work through
+ * the interior rows; it joins them once all messages are done. Only
+ * the master calls MPI, so MPI_THREAD_FUNNELED is enough, and the
+ * exchange progresses because a thread drives it, whatever the MPI
+ * library does in the background.
+ *
+ */
+
+#include "overlap.h"
+
+// rows per chunk of the interior, handed out dynamically so the
+// communication thread can take the rest when it is done
+#define OVERLAP_ROWS 8
+
+enum { WEST, EAST, NORTH, SOUTH, DIRS };
+
+static double jacobi_point( double *u, double *utmp, int ii, int sizex,
+			    int j )
+{
+  double unew = 0.25 * (u[ ii+(j-1) ]+
+			u[ ii+(j+1) ]+
+			u[ ii-sizex+j ]+
+			u[ ii+sizex+j ]);
+  double diff = unew - u[ii + j];
+  utmp[ii+j] = unew;
+  return(diff * diff);
+}
+
+/*
+ * boundary strip s: rows 1 and rows in full, columns 1 and cols
+ * without the corners
+ */
+static double jacobi_strip( double *u, double *utmp, int rows, int cols,
+			    int s )
+{
+  const int sizex = cols+2;
+  double sum=0.0;
+  int i, j;
+
+  switch (s) {
+  case NORTH:
+  case SOUTH:
+    i = (s == NORTH) ? 1 : rows;
+    if (s == SOUTH && rows == 1)
+      break;
+    for (j = 1; j <= cols; j++)
+      sum += jacobi_point(u, utmp, i*sizex, sizex, j);
+    break;
+  case WEST:
+  case EAST:
+    j = (s == WEST) ? 1 : cols;
+    if (s == EAST && cols == 1)
+      break;
+    for (i = 2; i < rows; i++)
+      sum += jacobi_point(u, utmp, i*sizex, sizex, j);
+    break;
+  }
+  return(sum);
+}
+
+/*
+ * One Jacobi sweep from param->u into param->uhelp including the new
+ * halo, then swaps the two. Returns the local residual; the boundary
+ * strips always sum it up, the interior only if residual is set.
+ */
+double relax_jacobi_overlap( algoparam_t *param, MPI_Comm comm,
+			     int residual )
+{
+  const int rows = param->rows, cols = param->cols;
+  const int sizex = cols+2;
+  const int nbr[DIRS] = { param->west, param->east,
+			  param->north, param->south };
+  double *u = param->u, *utmp = param->uhelp;
+  double *sbuf = param->sbuf, *rbuf = param->rbuf;
+  MPI_Request recv[DIRS], send[DIRS];
+  double sum=0.0;
+
+#pragma omp parallel reduction(+:sum)
+  {
+    int s, i, j;
+
+#pragma omp master
+    {
+      // the rows go straight into the halo of utmp, the columns
+      // through rbuf; the tag is the direction the data travels in
+      MPI_Irecv(&rbuf[0], rows, MPI_DOUBLE, nbr[WEST], EAST, comm, &recv[WEST]);
+      MPI_Irecv(&rbuf[rows], rows, MPI_DOUBLE, nbr[EAST], WEST, comm, &recv[EAST]);
+      MPI_Irecv(&utmp[1], cols, MPI_DOUBLE, nbr[NORTH], SOUTH, comm, &recv[NORTH]);
+      MPI_Irecv(&utmp[(rows+1)*sizex+1], cols, MPI_DOUBLE, nbr[SOUTH], NORTH, comm, &recv[SOUTH]);
+    }
+
+#pragma omp for schedule(static)
+    for (s = 0; s < DIRS; s++)
+      sum += jacobi_strip(u, utmp, rows, cols, s);
+
+#pragma omp master
+    {
+      int d;
+
+      for (i = 0; i < rows; i++) sbuf[i] = utmp[(i+1)*sizex+1];
+      for (i = 0; i < rows; i++) sbuf[rows+i] = utmp[(i+1)*sizex+cols];
+      MPI_Isend(&sbuf[0], rows, MPI_DOUBLE, nbr[WEST], WEST, comm, &send[WEST]);
+      MPI_Isend(&sbuf[rows], rows, MPI_DOUBLE, nbr[EAST], EAST, comm, &send[EAST]);
+      MPI_Isend(&utmp[sizex+1], cols, MPI_DOUBLE, nbr[NORTH], NORTH, comm, &send[NORTH]);
+      MPI_Isend(&utmp[rows*sizex+1], cols, MPI_DOUBLE, nbr[SOUTH], SOUTH, comm, &send[SOUTH]);
+
+      // missing neighbours leave the fixed boundary in the halo
+      for (;;) {
+	MPI_Waitany(DIRS, recv, &d, MPI_STATUS_IGNORE);
+	if (d == MPI_UNDEFINED)
+	  break;
+	if (d == WEST && nbr[WEST] != MPI_PROC_NULL)
+	  for (i = 0; i < rows; i++) utmp[(i+1)*sizex] = rbuf[i];
+	if (d == EAST && nbr[EAST] != MPI_PROC_NULL)
+	  for (i = 0; i < rows; i++) utmp[(i+1)*sizex+cols+1] = rbuf[rows+i];
+      }
+      MPI_Waitall(DIRS, send, MPI_STATUSES_IGNORE);
+    }
+
+    if (residual) {
+#pragma omp for schedule(dynamic, OVERLAP_ROWS) nowait
+      for (i = 2; i < rows; i++)
+	for (j = 2; j < cols; j++)
+	  sum += jacobi_point(u, utmp, i*sizex, sizex, j);
+    } else {
+#pragma omp for schedule(dynamic, OVERLAP_ROWS) nowait
+      for (i = 2; i < rows; i++) {
+	int ii=i*sizex;
+#pragma ivdep
+	for (j = 2; j < cols; j++)
+	  utmp[ii+j] = 0.25 * (u[ ii+(j-1) ]+
+			       u[ ii+(j+1) ]+
+			       u[ ii-sizex+j ]+
+			       u[ ii+sizex+j ]);
+      }
+    }
+  }
+
+  swap(&(param->u), &(param->uhelp));
+  return(sum);
+}
@@ -0,0 +1,16 @@
+//
+// overlap.h
+//
+
+#ifndef OVERLAP_H_INCLUDED
+#define OVERLAP_H_INCLUDED
+
+#include <mpi.h>
+
+#include "heat.h"
+
+double relax_jacobi_overlap( algoparam_t *param, MPI_Comm comm,
+			     int residual );
+
+
+#endif // OVERLAP_H_INCLUDED
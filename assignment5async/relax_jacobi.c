@@ -90,7 +90,7 @@ double relax_jacobi_outer( double **u1, double **utmp1, unsigned sizex, unsigned
   return(sum);
 }
 
-double relax_jacobi_inner( double **u1, double **utmp1, unsigned sizex, unsigned sizey)
+double relax_jacobi_inner( double **u1, double **utmp1, unsigned sizex, unsigned sizey, int residual)
 {
   int i, j;
   double *help,*u, *utmp,factor=0.5;
@@ -99,6 +99,24 @@ double relax_jacobi_inner( double **u1, double **utmp1, unsigned sizex, unsigned
   u=*u1;
   double unew, diff, sum=0.0;
 
+  // the same sweep without the reduction; the outer points are
+  // few, relax_jacobi_outer always sums them up
+  if (!residual) {
+#pragma omp parallel for firstprivate(sizey, j, sizex)
+    for( i=2; i<sizey-2; i++ ) {
+      int ii=i*sizex;
+      int iim1=(i-1)*sizex;
+      int iip1=(i+1)*sizex;
+#pragma ivdep
+      for( j=2; j<sizex-2; j++ )
+        utmp[ii+j] = 0.25 * (u[ ii+(j-1) ]+
+                             u[ ii+(j+1) ]+
+                             u[ iim1+j ]+
+                             u[ iip1+j ]);
+    }
+    return(0);
+  }
+
 #pragma omp parallel for firstprivate(sizey, j, unew, diff, sizex) reduction(+:sum)
   for( i=2; i<sizey-2; i++ ) {
   	int ii=i*sizex;